@@ -0,0 +1,121 @@
+/** @example benchBlockCompressor.cpp
+ * Micro-benchmark of the BlockCompressor kernels (computeDelta, quantize, dequantize) and of
+ * dataEncode/dataDecode on 8x8 and 16x16 blocks of LOT transformed data.
+ * Each kernel is timed with the scalar code and with the vectorized code (Transformer::c_vectorized).
+ *
+ * usage: benchcompress [number of blocks] [repetitions]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+#include "compress/Transformer.h"
+#include "compress/BlockCompressor.h"
+
+using namespace std;
+
+static double seconds(chrono::steady_clock::time_point t0) {
+  return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[]) {
+  int nblocks = (argc > 1) ? atoi(argv[1]) : 4096;
+  int nreps = (argc > 2) ? atoi(argv[2]) : 20;
+  float distortion = 0.1f;
+
+  for(int transLength = 8; transLength <= 16; transLength += 8) {
+    int blockSize = transLength * transLength;
+    long n = (long)nblocks * blockSize;
+
+    // synthetic traces, transformed with the LOT of the given length
+    float *data = new float[n];
+    float *scratch = new float[n + 2 * transLength];
+    srand(1);
+    for(long i = 0; i < n; i++) {
+      data[i] = sinf(0.05f * (i % 1000)) * (1.f + (i / 1000) % 7) + 0.05f * (rand() / (float)RAND_MAX - 0.5f);
+    }
+    jsIO::Transformer transformer;
+    transformer.lotFwd(data, 0, transLength, transLength, n / transLength, scratch);
+
+    float *deltas = new float[nblocks];
+    int *quant[2] = {new int[n], new int[n]};
+    float *dequant[2] = {new float[n], new float[n]};
+    int encodedSize = blockSize * 8 + 64;
+    char *encoded = new char[(long)nblocks * encodedSize];
+    int *encodedLen = new int[nblocks];
+    char *workBuffer = new char[encodedSize];
+    float *decoded = new float[blockSize];
+    double tDelta[2], tQuant[2], tDequant[2], tEncode[2], tDecode[2];
+    float deltaDiff = 0.f;
+
+    jsIO::BlockCompressor blockCompressor;
+    for(int vec = 0; vec < 2; vec++) {
+      jsIO::Transformer::c_vectorized = (vec == 1);
+
+      auto t0 = chrono::steady_clock::now();
+      for(int r = 0; r < nreps; r++)
+        for(int b = 0; b < nblocks; b++) {
+          float delta = jsIO::BlockCompressor::computeDelta(&data[(long)b * blockSize], blockSize, distortion);
+          if(vec == 0) deltas[b] = delta;
+          else if(fabsf(delta - deltas[b]) > deltaDiff) deltaDiff = fabsf(delta - deltas[b]);
+        }
+      tDelta[vec] = seconds(t0);
+
+      t0 = chrono::steady_clock::now();
+      for(int r = 0; r < nreps; r++)
+        for(int b = 0; b < nblocks; b++)
+          jsIO::BlockCompressor::quantize(&data[(long)b * blockSize], blockSize, deltas[b], &quant[vec][(long)b * blockSize]);
+      tQuant[vec] = seconds(t0);
+
+      t0 = chrono::steady_clock::now();
+      for(int r = 0; r < nreps; r++)
+        for(int b = 0; b < nblocks; b++)
+          jsIO::BlockCompressor::dequantize(&quant[vec][(long)b * blockSize], blockSize, deltas[b], &dequant[vec][(long)b * blockSize]);
+      tDequant[vec] = seconds(t0);
+
+      t0 = chrono::steady_clock::now();
+      for(int r = 0; r < nreps; r++)
+        for(int b = 0; b < nblocks; b++)
+          encodedLen[b] = blockCompressor.dataEncode(&data[(long)b * blockSize], blockSize, distortion,
+                                                     &encoded[(long)b * encodedSize], 0, encodedSize);
+      tEncode[vec] = seconds(t0);
+
+      t0 = chrono::steady_clock::now();
+      for(int r = 0; r < nreps; r++)
+        for(int b = 0; b < nblocks; b++)
+          blockCompressor.dataDecode(&encoded[(long)b * encodedSize], 0, workBuffer, encodedSize, blockSize, decoded);
+      tDecode[vec] = seconds(t0);
+    }
+    jsIO::Transformer::c_vectorized = true;
+
+    bool quantEqual = memcmp(quant[0], quant[1], n * sizeof(int)) == 0;
+    bool dequantEqual = memcmp(dequant[0], dequant[1], n * sizeof(float)) == 0;
+
+    double nsamps = (double)n * nreps;
+    printf("%dx%d blocks (%d blocks, %d repetitions), ns per sample:\n", transLength, transLength, nblocks, nreps);
+    printf("  %-14s %9s %9s %8s\n", "", "scalar", "vector", "speedup");
+    printf("  %-14s %9.3f %9.3f %7.2fx\n", "computeDelta", 1e9 * tDelta[0] / nsamps, 1e9 * tDelta[1] / nsamps, tDelta[0] / tDelta[1]);
+    printf("  %-14s %9.3f %9.3f %7.2fx\n", "quantize", 1e9 * tQuant[0] / nsamps, 1e9 * tQuant[1] / nsamps, tQuant[0] / tQuant[1]);
+    printf("  %-14s %9.3f %9.3f %7.2fx\n", "dequantize", 1e9 * tDequant[0] / nsamps, 1e9 * tDequant[1] / nsamps, tDequant[0] / tDequant[1]);
+    printf("  %-14s %9.3f %9.3f %7.2fx\n", "dataEncode", 1e9 * tEncode[0] / nsamps, 1e9 * tEncode[1] / nsamps, tEncode[0] / tEncode[1]);
+    printf("  %-14s %9.3f %9.3f %7.2fx\n", "dataDecode", 1e9 * tDecode[0] / nsamps, 1e9 * tDecode[1] / nsamps, tDecode[0] / tDecode[1]);
+    printf("  quantized data identical: %s, dequantized data identical: %s, max delta difference: %g\n",
+           quantEqual ? "yes" : "NO", dequantEqual ? "yes" : "NO", deltaDiff);
+
+    delete[] data;
+    delete[] scratch;
+    delete[] deltas;
+    for(int vec = 0; vec < 2; vec++) {
+      delete[] quant[vec];
+      delete[] dequant[vec];
+    }
+    delete[] encoded;
+    delete[] encodedLen;
+    delete[] workBuffer;
+    delete[] decoded;
+  }
+  return 0;
+}
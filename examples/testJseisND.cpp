@@ -180,5 +180,50 @@ int main(int argc, char *argv[]) {
   jsnd4.Close();
   cout << "finish 4" << endl;
 
+  // step 5 : hyperslab of a volume with dead traces inside the frames (traces 5-9 of every frame are dead)
+  std::string fname5 = "/tmp/junk5d5.js";
+  jsIO::oJseisND jsnd5(fname5, 3, lengths, logicalOrigins, logicalDeltas, physicalOrigins, physicalDeltas, axisHdrs, jsIO::DataFormat::FLOAT);
+  size_t traceheaderSize5 = jsnd5.jsWrt.getTraceHeaderSize();
+  char *hdbuf5 = jsnd5.jsWrt.allocHdrBuf(true, lengths[2]);
+  for(iframe = 0; iframe < lengths[2]; iframe++) {
+    for(int i2 = 0; i2 < lengths[1]; i2++) {
+      size_t offset = (iframe * lengths[1] + i2) * traceheaderSize5;
+      jsnd5.itrcTypeHdr.setIntVal(&hdbuf5[offset], (i2 >= 5 && i2 <= 9) ? 0 : 1);
+      jsnd5.itrcHdr.setIntVal(&hdbuf5[offset], logicalOrigins[1] + i2 * logicalDeltas[1]);
+      jsnd5.ifrmHdr.setIntVal(&hdbuf5[offset], logicalOrigins[2] + iframe * logicalDeltas[2]);
+    }
+  }
+  float *volbuf5 = new float[lengths[0]*lengths[1]*lengths[2]];
+  memcpy(volbuf5, volbuf, sizeof(float) * lengths[0]*lengths[1]*lengths[2]);
+  jsnd5.write_volume(volbuf5, hdbuf5, 0); // left justifies volbuf5
+  jsnd5.Close();
+  delete[] hdbuf5;
+
+  jsIO::jsFileReader jsr5;
+  jsr5.Init(fname5, 2);
+  int start[3] = {2, 1, 1};
+  int count[3] = {lengths[0] - 4, (lengths[1] - 1) / 2, (lengths[2] - 1) / 2};
+  int stride[3] = {1, 2, 2};
+  float *slab = new float[count[0]*count[1]*count[2]];
+  long nLive = jsr5.readHyperslab(start, count, stride, slab);
+  long nErrors = 0, nLiveExpected = 0;
+  for(int i2 = 0; i2 < count[2]; i2++)
+    for(int i1 = 0; i1 < count[1]; i1++) {
+      int itr = start[1] + i1 * stride[1];
+      bool bDead = (itr >= 5 && itr <= 9);
+      if(!bDead) nLiveExpected++;
+      for(int i0 = 0; i0 < count[0]; i0++) {
+        size_t in = ((size_t)(start[2] + i2 * stride[2]) * lengths[1] + itr) * lengths[0] + start[0] + i0;
+        if(slab[((size_t)i2 * count[1] + i1) * count[0] + i0] != (bDead ? 0.0f : volbuf[in])) nErrors++;
+      }
+    }
+  delete[] slab;
+  delete[] volbuf5;
+  if(nErrors > 0 || nLive != nLiveExpected) {
+    cout << "hyperslab error: " << nErrors << " wrong samples, " << nLive << " live traces (expected " << nLiveExpected << ")" << endl;
+    return 1;
+  }
+  cout << "finish 5" << endl;
+
   return 0;
 }
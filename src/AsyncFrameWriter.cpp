@@ -0,0 +1,141 @@
+/***************************************************************************
+ AsyncFrameWriter.cpp
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#include "AsyncFrameWriter.h"
+
+#include "jsDefs.h"
+#include "PSProLogging.h"
+
+namespace jsIO {
+DECLARE_LOGGER(AsyncFrameWriterLog);
+
+AsyncFrameWriter::AsyncFrameWriter(int _nWorkers, int _queueDepth, EncodeFunc _encode, WriteFunc _write) :
+  m_encode(_encode), m_write(_write), m_status(JS_OK) {
+  if(_nWorkers < 1) _nWorkers = 1;
+  m_queueDepth = (_queueDepth > 0) ? _queueDepth : 4 * _nWorkers;
+  for(int i = 0; i < _nWorkers; i++)
+    m_workers.push_back(std::thread(&AsyncFrameWriter::workerLoop, this, i));
+  m_ioThread = std::thread(&AsyncFrameWriter::ioLoop, this);
+  TRACE_PRINTF(AsyncFrameWriterLog, "Started %d encoding threads, queue depth %d", _nWorkers, m_queueDepth);
+}
+
+AsyncFrameWriter::~AsyncFrameWriter() {
+  finish();
+}
+
+void AsyncFrameWriter::setError(int _status) {
+  // keep the first error only
+  if(m_status == JS_OK) m_status = _status;
+}
+
+int AsyncFrameWriter::submit(AsyncFrameJob *_job) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if(m_bStop) {
+    delete _job;
+    ERROR_PRINTF(AsyncFrameWriterLog, "Can't queue frame, the writer is already closed");
+    return JS_USERERROR;
+  }
+  while(m_numInFlight >= m_queueDepth)
+    m_cvSubmit.wait(lock);
+  _job->seq = m_nextSeq++;
+  m_toEncode.push_back(_job);
+  m_numInFlight++;
+  m_cvWork.notify_one();
+  return m_status;
+}
+
+int AsyncFrameWriter::flush() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while(m_numInFlight > 0)
+    m_cvDone.wait(lock);
+  return m_status;
+}
+
+int AsyncFrameWriter::finish() {
+  int ires = flush();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bStop = true;
+  }
+  m_cvWork.notify_all();
+  m_cvIO.notify_all();
+  for(size_t i = 0; i < m_workers.size(); i++) {
+    if(m_workers[i].joinable()) m_workers[i].join();
+  }
+  if(m_ioThread.joinable()) m_ioThread.join();
+  return ires;
+}
+
+void AsyncFrameWriter::workerLoop(int _workerIndex) {
+  while(true) {
+    AsyncFrameJob *job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while(m_toEncode.empty() && !m_bStop)
+        m_cvWork.wait(lock);
+      if(m_toEncode.empty()) return;
+      job = m_toEncode.front();
+      m_toEncode.pop_front();
+    }
+
+    int ires = m_encode(*job, _workerIndex);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(ires != JS_OK) {
+      ERROR_PRINTF(AsyncFrameWriterLog, "Can't encode frame %ld", job->frameIndex);
+      setError(ires);
+    }
+    m_toWrite[job->seq] = job;
+    if(job->seq == m_nextWriteSeq) m_cvIO.notify_one();
+  }
+}
+
+void AsyncFrameWriter::ioLoop() {
+  while(true) {
+    AsyncFrameJob *job;
+    bool bWrite;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      std::map<long, AsyncFrameJob *>::iterator it;
+      while((it = m_toWrite.find(m_nextWriteSeq)) == m_toWrite.end()) {
+        if(m_bStop && m_numInFlight == 0) return;
+        m_cvIO.wait(lock);
+      }
+      job = it->second;
+      m_toWrite.erase(it);
+      // after an error nothing more is written, the frames are only dropped
+      bWrite = (m_status == JS_OK);
+    }
+
+    int ires = bWrite ? m_write(*job) : JS_OK;
+    if(ires != JS_OK) ERROR_PRINTF(AsyncFrameWriterLog, "Can't write frame %ld", job->frameIndex);
+    delete job;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(ires != JS_OK) setError(ires);
+    m_nextWriteSeq++;
+    m_numInFlight--;
+    m_cvSubmit.notify_one();
+    if(m_numInFlight == 0) m_cvDone.notify_all();
+  }
+}
+
+}
@@ -0,0 +1,117 @@
+/***************************************************************************
+ AsyncFrameWriter.h
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#ifndef ASYNCFRAMEWRITER_H
+#define ASYNCFRAMEWRITER_H
+
+#include <stdio.h>
+#include <deque>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace jsIO {
+
+// A frame queued for writing. Frame and header buffers (allocated with new[]) belong to the job.
+struct AsyncFrameJob {
+  AsyncFrameJob() {}
+  ~AsyncFrameJob() {
+    if(frame != NULL) delete[] frame;
+    if(headbuf != NULL) delete[] headbuf;
+    if(encoded != NULL) delete[] encoded;
+  }
+
+  long frameIndex { };
+  float *frame { };
+  char *headbuf { };
+  int numLiveTraces { };
+  bool bWriteTraceMap { };
+
+  char *encoded { };  // compressed trace data, NULL for FLOAT data
+  long encodedLen { };
+
+  long seq { }; // submission number, set by AsyncFrameWriter
+};
+
+/**
+ * Write-behind pipeline used by jsFileWriter.
+ * Submitted frames are encoded (compressed) in parallel by a pool of worker threads
+ * and written by one I/O thread strictly in submission order.
+ * The first error of the encode or write function is kept and returned by submit(), flush() and finish().
+ */
+class AsyncFrameWriter {
+public:
+  // encode(job, workerIndex) and write(job) return JS_OK on success
+  typedef std::function<int(AsyncFrameJob &, int)> EncodeFunc;
+  typedef std::function<int(AsyncFrameJob &)> WriteFunc;
+
+  AsyncFrameWriter(int _nWorkers, int _queueDepth, EncodeFunc _encode, WriteFunc _write);
+  ~AsyncFrameWriter();
+
+  /*
+   * Queues the job and takes its ownership. Blocks while _queueDepth frames are in flight.
+   * Returns the pipeline status, i.e. JS_OK or the first error that occured.
+   */
+  int submit(AsyncFrameJob *_job);
+
+  // waits until all submitted frames are written
+  int flush();
+
+  // flushes and stops the threads
+  int finish();
+
+  int getNumWorkers() const {
+    return m_workers.size();
+  }
+
+private:
+  void workerLoop(int _workerIndex);
+  void ioLoop();
+  void setError(int _status);
+
+private:
+  EncodeFunc m_encode;
+  WriteFunc m_write;
+  int m_queueDepth { };
+
+  std::mutex m_mutex;
+  std::condition_variable m_cvSubmit; // a slot in the queue got free
+  std::condition_variable m_cvWork;   // a job waits for encoding
+  std::condition_variable m_cvIO;     // a job waits for writing
+  std::condition_variable m_cvDone;   // a job was written
+
+  std::deque<AsyncFrameJob *> m_toEncode;
+  std::map<long, AsyncFrameJob *> m_toWrite; // encoded jobs by submission number
+  long m_nextSeq { };
+  long m_nextWriteSeq { };
+  long m_numInFlight { };
+  int m_status;
+  bool m_bStop { };
+
+  std::vector<std::thread> m_workers;
+  std::thread m_ioThread;
+};
+}
+
+#endif
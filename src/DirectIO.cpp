@@ -0,0 +1,170 @@
+/***************************************************************************
+ DirectIO.cpp
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "DirectIO.h"
+#include "FileUtil.h"
+#include "PSProLogging.h"
+
+namespace jsIO {
+DECLARE_LOGGER(DirectIOLog);
+
+// size of the bounce buffer used for unaligned user buffers
+static const size_t BOUNCE_BUFFER_SIZE = 1024 * 1024;
+
+static inline bool isAligned(unsigned long _value) {
+  return (_value & (DIRECT_IO_ALIGNMENT - 1)) == 0;
+}
+
+static inline off_t alignDown(off_t _value) {
+  return _value & ~(DIRECT_IO_ALIGNMENT - 1);
+}
+
+static inline off_t alignUp(off_t _value) {
+  return alignDown(_value + DIRECT_IO_ALIGNMENT - 1);
+}
+
+// aligned bounce buffer of the calling thread, NULL if it can't be allocated
+static char *bounceBuffer() {
+  struct Holder {
+    char *buffer { };
+    ~Holder() {
+      free(buffer);
+    }
+  };
+  static thread_local Holder holder;
+  if(holder.buffer == NULL && posix_memalign((void**)&holder.buffer, DIRECT_IO_ALIGNMENT, BOUNCE_BUFFER_SIZE) != 0)
+    holder.buffer = NULL;
+  return holder.buffer;
+}
+
+// O_DIRECT pread of aligned blocks until the end of file, a short unaligned read marks the end of file
+static ssize_t preadAligned(int _fd, char *_buf, size_t _nbytes, off_t _offset) {
+  size_t done = 0;
+  while(done < _nbytes) {
+    ssize_t ret = ::pread(_fd, _buf + done, _nbytes - done, _offset + done);
+    if(ret < 0) {
+      if(errno == EINTR) continue;
+      return -1;
+    }
+    if(ret == 0) break;
+    done += ret;
+    if(!isAligned(done)) break;
+  }
+  return done;
+}
+
+static ssize_t pwriteAligned(int _fd, const char *_buf, size_t _nbytes, off_t _offset) {
+  size_t done = 0;
+  while(done < _nbytes) {
+    ssize_t ret = ::pwrite(_fd, _buf + done, _nbytes - done, _offset + done);
+    if(ret < 0) {
+      if(errno == EINTR) continue;
+      return -1;
+    }
+    if(ret == 0 || !isAligned(ret)) break;
+    done += ret;
+  }
+  return done;
+}
+
+int openDirect(const char *_path, int _flags) {
+  int fd = ::open(_path, _flags | O_DIRECT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+  if(fd < 0) TRACE_PRINTF(DirectIOLog, "Can't open %s with O_DIRECT (%s), use buffered I/O", _path, strerror(errno));
+  return fd;
+}
+
+ssize_t preadDirect(int _directFd, int _fd, void *_buf, size_t _nbytes, off_t _offset) {
+  char *dst = (char*)_buf;
+  char *bounce = (_directFd >= 0) ? bounceBuffer() : NULL;
+  size_t done = 0;
+  while(bounce != NULL && done < _nbytes) {
+    off_t offset = _offset + done;
+    size_t rest = _nbytes - done;
+    if(isAligned(offset) && isAligned((unsigned long)(dst + done)) && rest >= (size_t)DIRECT_IO_ALIGNMENT) {
+      size_t n = alignDown(rest);
+      ssize_t ret = preadAligned(_directFd, dst + done, n, offset);
+      if(ret < 0) break;
+      done += ret;
+      if((size_t)ret < n) return done; // end of file
+    } else {
+      off_t start = alignDown(offset);
+      size_t skip = offset - start;
+      size_t n = std::min(BOUNCE_BUFFER_SIZE, (size_t)alignUp(skip + rest));
+      ssize_t ret = preadAligned(_directFd, bounce, n, start);
+      if(ret < 0) break;
+      size_t avail = ((size_t)ret > skip) ? std::min((size_t)ret - skip, rest) : 0;
+      memcpy(dst + done, bounce + skip, avail);
+      done += avail;
+      if((size_t)ret < n) return done; // end of file
+    }
+  }
+  if(done < _nbytes) {
+    if(bounce != NULL) TRACE_PRINTF(DirectIOLog, "O_DIRECT read failed (%s), use buffered read", strerror(errno));
+    ssize_t ret = wrapIOFull(pread, _fd, dst + done, _nbytes - done, _offset + done);
+    if(ret < 0) return -1;
+    done += ret;
+  }
+  return done;
+}
+
+ssize_t pwriteDirect(int _directFd, int _fd, const void *_buf, size_t _nbytes, off_t _offset) {
+  const char *src = (const char*)_buf;
+  off_t end = _offset + _nbytes;
+  off_t midBegin = alignUp(_offset);
+  off_t midEnd = alignDown(end);
+  char *bounce = (_directFd >= 0 && midEnd > midBegin) ? bounceBuffer() : NULL;
+  if(bounce == NULL) return wrapIOFull(pwrite, _fd, _buf, _nbytes, _offset);
+
+  // the head and tail blocks are shared with neighbouring data, they go through the page cache
+  if(midBegin > _offset && wrapIOFull(pwrite, _fd, src, midBegin - _offset, _offset) != midBegin - _offset) return -1;
+  if(end > midEnd && wrapIOFull(pwrite, _fd, src + (midEnd - _offset), end - midEnd, midEnd) != end - midEnd) return -1;
+
+  off_t offset = midBegin;
+  while(offset < midEnd) {
+    const char *p = src + (offset - _offset);
+    size_t n = midEnd - offset;
+    ssize_t ret;
+    if(isAligned((unsigned long)p)) {
+      ret = pwriteAligned(_directFd, p, n, offset);
+    } else {
+      n = std::min(n, BOUNCE_BUFFER_SIZE);
+      memcpy(bounce, p, n);
+      ret = pwriteAligned(_directFd, bounce, n, offset);
+    }
+    if(ret != (ssize_t)n) {
+      TRACE_PRINTF(DirectIOLog, "O_DIRECT write failed (%s), use buffered write", strerror(errno));
+      if(wrapIOFull(pwrite, _fd, p, midEnd - offset, offset) != midEnd - offset) return -1;
+      break;
+    }
+    offset += n;
+  }
+  return _nbytes;
+}
+}
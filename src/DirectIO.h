@@ -0,0 +1,54 @@
+/***************************************************************************
+ DirectIO.h
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#ifndef DIRECTIO_H
+#define DIRECTIO_H
+
+#include <sys/types.h>
+
+namespace jsIO {
+
+// alignment of the buffers, file offsets and lengths of O_DIRECT transfers
+const long DIRECT_IO_ALIGNMENT = 4096;
+
+/*
+ * Opens _path with O_DIRECT added to _flags.
+ * return the file descriptor, or -1 if the file can't be opened or the filesystem rejects O_DIRECT
+ */
+int openDirect(const char *_path, int _flags);
+
+/*
+ * Reads _nbytes at _offset. The block-aligned part is read with the O_DIRECT descriptor _directFd
+ * (in place if _buf is aligned, otherwise through an aligned bounce buffer), the rest with the buffered
+ * descriptor _fd of the same file. If _directFd is -1 or rejects the transfer, everything is read with _fd.
+ * return the number of bytes read (less than _nbytes at the end of file), or -1 on error
+ */
+ssize_t preadDirect(int _directFd, int _fd, void *_buf, size_t _nbytes, off_t _offset);
+
+/*
+ * Writes _nbytes at _offset. The block-aligned middle part is written with _directFd, the unaligned
+ * head and tail bytes with _fd. If _directFd is -1 or rejects the transfer, everything is written with _fd.
+ * return the number of bytes written, or -1 on error
+ */
+ssize_t pwriteDirect(int _directFd, int _fd, const void *_buf, size_t _nbytes, off_t _offset);
+}
+
+#endif
@@ -22,7 +22,6 @@
  ***************************************************************************/
 
 #include <unistd.h>
-#include <csignal>
 #include "ExtentList.h"
 
 #include "PSProLogging.h"
@@ -231,15 +230,27 @@ int ExtentList::loadExtents() {
  */
 int ExtentList::getExtentIndex(long position) const {
   if(position < 0 || position > maxFilePosition) {
-    fprintf(stderr, "Requested position %ld must between [0,%ld]", position, maxFilePosition);
-    raise(SIGINT);
+    ERROR_PRINTF(ExtentListLog, "Requested position %ld must be in [0,%ld]", position, maxFilePosition);
+    return JS_USERERROR;
+  }
+  // index of the last extent starting before position, -1 if there is none
+  if(numExtents <= 0 || position <= extents[0].getStartOffset()) return -1;
+
+  // the extents are sorted and (except the last one) usually extentSize long, so try to compute the index first
+  if(extentSize > 0) {
+    long index = std::min((position - 1) / extentSize, (long)numExtents - 1);
+    if(extents[index].getStartOffset() < position
+        && (index == numExtents - 1 || position <= extents[index + 1].getStartOffset())) return index;
   }
-  int index = 0;
-  while(index < numExtents && position > extents[index].getStartOffset()) {
-    index++;
+
+  int low = 0; // extents[low] starts before position
+  int high = numExtents - 1;
+  while(low < high) {
+    int mid = low + (high - low + 1) / 2;
+    if(extents[mid].getStartOffset() < position) low = mid;
+    else high = mid - 1;
   }
-  index--;
-  return index;
+  return low;
 }
 
 // The the path based on the extent index
@@ -87,7 +87,7 @@ public:
 
   int createExtents();
   int loadExtents();
-  int getExtentIndex(long position) const;
+  int getExtentIndex(long position) const; //extent of the byte position-1 (-1 for position 0), <0 if invalid
 
   int saveXML(std::string _path); //save to XML
 
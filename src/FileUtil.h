@@ -23,6 +23,7 @@ ssize_t wrapIOFull(F f, int fd, const void *buf0, size_t nbytes, off_t offset) {
       perror("wrapIOFull(): ");
       return ((ssize_t)-1);
     }
+    if(ret == 0) break; // end of file
     buf += ret;
     offset += ret;
     nbytes -= ret;
@@ -0,0 +1,58 @@
+/***************************************************************************
+ FrameBufferPool.cpp
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#include "FrameBufferPool.h"
+#include "MappedExtents.h"
+
+namespace jsIO {
+
+FrameBufferPool::~FrameBufferPool() {
+  for(size_t i = 0; i < m_free.size(); i++)
+    delete m_free[i];
+}
+
+std::shared_ptr<FrameData> FrameBufferPool::get(bool _withHeaders) {
+  FrameData *data = NULL;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_free.empty()) {
+      data = m_free.back();
+      m_free.pop_back();
+    }
+  }
+  if(data == NULL) data = new FrameData();
+  if(data->frame == NULL) data->frame = new float[m_frameLength];
+  if(_withHeaders && data->headers == NULL) data->headers = new char[m_headerLength];
+
+  // the deleter keeps the pool alive until the last view is released
+  std::shared_ptr<FrameBufferPool> self = shared_from_this();
+  return std::shared_ptr<FrameData>(data, [self](FrameData * _data) {
+    self->put(_data);
+  });
+}
+
+void FrameBufferPool::put(FrameData *_data) {
+  _data->mappedTR.reset();
+  _data->mappedHD.reset();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_free.push_back(_data);
+}
+}
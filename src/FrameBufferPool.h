@@ -0,0 +1,77 @@
+/***************************************************************************
+ FrameBufferPool.h
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#ifndef FRAMEBUFFERPOOL_H
+#define FRAMEBUFFERPOOL_H
+
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+#include <memory>
+
+namespace jsIO {
+
+class MappedExtents;
+
+// Buffers of a frame referred to by FrameView objects.
+struct FrameData {
+  ~FrameData() {
+    if(frame != NULL) delete[] frame;
+    if(headers != NULL) delete[] headers;
+  }
+
+  float *frame { };
+  char *headers { };
+  // mapped extents the view points into (memory-mapped read mode)
+  std::shared_ptr<MappedExtents> mappedTR;
+  std::shared_ptr<MappedExtents> mappedHD;
+};
+
+/**
+ * Frame buffers of a jsFileReader for FrameView objects.
+ * The buffers of a released view are returned to the pool and reused. The pool lives
+ * as long as the reader or any view of it, so views may outlive the reader.
+ */
+class FrameBufferPool : public std::enable_shared_from_this<FrameBufferPool> {
+public:
+  FrameBufferPool(long _frameLength, long _headerLength) :
+    m_frameLength(_frameLength), m_headerLength(_headerLength) {
+  }
+  ~FrameBufferPool();
+
+  /*
+   * Returns buffers for a frame. The frame buffer (and the header buffer if _withHeaders)
+   * are allocated, the caller may also attach mapped extents.
+   */
+  std::shared_ptr<FrameData> get(bool _withHeaders);
+
+private:
+  void put(FrameData *_data);
+
+private:
+  long m_frameLength { };  // floats
+  long m_headerLength { }; // bytes
+  std::mutex m_mutex;
+  std::vector<FrameData *> m_free;
+};
+}
+
+#endif
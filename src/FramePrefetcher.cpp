@@ -0,0 +1,154 @@
+/***************************************************************************
+ FramePrefetcher.cpp
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#include "FramePrefetcher.h"
+
+#include <string.h>
+
+#include "jsDefs.h"
+#include "PSProLogging.h"
+
+namespace jsIO {
+DECLARE_LOGGER(FramePrefetcherLog);
+
+FramePrefetcher::FramePrefetcher(int _depth, long _rawFrameSize, long _numFrames, ReadFunc _read) :
+  m_read(_read), m_rawFrameSize(_rawFrameSize), m_numFrames(_numFrames) {
+  if(_depth < 1) _depth = 1;
+  m_slots.resize(_depth);
+  for(int i = 0; i < _depth; i++)
+    m_slots[i].buf = new char[m_rawFrameSize];
+  m_thread = std::thread(&FramePrefetcher::run, this);
+  TRACE_PRINTF(FramePrefetcherLog, "Started read-ahead of %d frames", _depth);
+}
+
+FramePrefetcher::~FramePrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bStop = true;
+  }
+  m_cvWork.notify_all();
+  m_thread.join();
+  for(size_t i = 0; i < m_slots.size(); i++)
+    delete[] m_slots[i].buf;
+  TRACE_PRINTF(FramePrefetcherLog, "Read-ahead stopped: %ld hits, %ld misses", (long)m_hits, (long)m_misses);
+}
+
+bool FramePrefetcher::isPlanned(long _frameIndex) const {
+  if(!m_bPlanned) return false;
+  long dist = _frameIndex - m_planFirst;
+  if(dist % m_planStride != 0) return false;
+  long k = dist / m_planStride;
+  return k >= 0 && k < (long)m_slots.size();
+}
+
+int FramePrefetcher::findSlot(long _frameIndex) const {
+  for(size_t i = 0; i < m_slots.size(); i++) {
+    if(m_slots[i].state != SLOT_EMPTY && m_slots[i].frameIndex == _frameIndex) return i;
+  }
+  return -1;
+}
+
+bool FramePrefetcher::fetch(long _frameIndex, char *_rawframe, long _len) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  // a planned frame is read next by the background thread, wait for it instead of reading it twice
+  int iSlot = findSlot(_frameIndex);
+  while((iSlot >= 0 && m_slots[iSlot].state == SLOT_READING) || (iSlot < 0 && isPlanned(_frameIndex))) {
+    m_cvReady.wait(lock);
+    iSlot = findSlot(_frameIndex);
+  }
+  if(iSlot < 0) {
+    m_misses++;
+    return false;
+  }
+  memcpy(_rawframe, m_slots[iSlot].buf, (_len < m_rawFrameSize) ? _len : m_rawFrameSize);
+  // a consumed frame is not kept, its slot can be refilled at once
+  m_slots[iSlot].state = SLOT_EMPTY;
+  m_slots[iSlot].frameIndex = -1;
+  m_hits++;
+  m_cvWork.notify_one();
+  return true;
+}
+
+void FramePrefetcher::access(long _frameIndex) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  long stride = (m_lastFrame < 0) ? 0 : _frameIndex - m_lastFrame;
+  // sequential access is assumed from the first step on, any other stride must repeat once
+  if(stride != 0 && (stride == 1 || stride == m_lastStride)) {
+    m_planFirst = _frameIndex + stride;
+    m_planStride = stride;
+    m_bPlanned = true;
+    m_cvWork.notify_one();
+  } else {
+    m_bPlanned = false;
+  }
+  m_lastFrame = _frameIndex;
+  m_lastStride = stride;
+}
+
+void FramePrefetcher::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while(!m_bStop) {
+    // next planned frame that is neither read nor being read
+    long frameIndex = -1;
+    if(m_bPlanned) {
+      for(size_t k = 0; k < m_slots.size(); k++) {
+        long f = m_planFirst + k * m_planStride;
+        if(f < 0 || f >= m_numFrames) break;
+        if(findSlot(f) < 0) {
+          frameIndex = f;
+          break;
+        }
+      }
+    }
+    // a free slot or one holding a frame which is no longer planned
+    int iSlot = -1;
+    if(frameIndex >= 0) {
+      for(size_t i = 0; i < m_slots.size() && iSlot < 0; i++) {
+        if(m_slots[i].state == SLOT_EMPTY) iSlot = i;
+      }
+      for(size_t i = 0; i < m_slots.size() && iSlot < 0; i++) {
+        if(m_slots[i].state == SLOT_READY && !isPlanned(m_slots[i].frameIndex)) iSlot = i;
+      }
+    }
+    if(iSlot < 0) {
+      m_cvWork.wait(lock);
+      continue;
+    }
+
+    Slot &slot = m_slots[iSlot];
+    slot.frameIndex = frameIndex;
+    slot.state = SLOT_READING;
+    lock.unlock();
+    int ires = m_read(frameIndex, slot.buf, &slot.numLiveTraces);
+    lock.lock();
+    if(ires != JS_OK) {
+      // leave the frame to the caller, who reports the error
+      ERROR_PRINTF(FramePrefetcherLog, "Can't read ahead frame %ld", frameIndex);
+      slot.state = SLOT_EMPTY;
+      slot.frameIndex = -1;
+      m_bPlanned = false;
+    } else {
+      slot.state = SLOT_READY;
+    }
+    m_cvReady.notify_all();
+  }
+}
+}
@@ -0,0 +1,112 @@
+/***************************************************************************
+ FramePrefetcher.h
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#ifndef FRAMEPREFETCHER_H
+#define FRAMEPREFETCHER_H
+
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace jsIO {
+
+/**
+ * Read-ahead of raw frames used by jsFileReader.
+ * The access pattern is tracked in access(); once a constant (sequential or strided) step
+ * between consecutive frames is seen, a background thread reads the next frames of that
+ * pattern into a ring of raw frame buffers. fetch() hands out a prefetched frame (hit)
+ * or reports that the caller has to read it itself (miss).
+ */
+class FramePrefetcher {
+public:
+  // read(frameIndex, rawframe, numLiveTraces) reads one raw frame, returns JS_OK on success
+  typedef std::function<int(long, char *, int *)> ReadFunc;
+
+  FramePrefetcher(int _depth, long _rawFrameSize, long _numFrames, ReadFunc _read);
+  ~FramePrefetcher();
+
+  /*
+   * Copies _len bytes of the prefetched raw frame _frameIndex into _rawframe.
+   * Waits if the frame is being read or is about to be read. Returns false (a miss) if the frame isn't prefetched.
+   */
+  bool fetch(long _frameIndex, char *_rawframe, long _len);
+
+  // records an access to _frameIndex and schedules read-ahead if the access pattern is regular
+  void access(long _frameIndex);
+
+  int getDepth() const {
+    return m_slots.size();
+  }
+  long getHits() const {
+    return m_hits;
+  }
+  long getMisses() const {
+    return m_misses;
+  }
+
+private:
+  enum SlotState {
+    SLOT_EMPTY, SLOT_READING, SLOT_READY
+  };
+  struct Slot {
+    long frameIndex { -1 };
+    int numLiveTraces { };
+    SlotState state { SLOT_EMPTY };
+    char *buf { };
+  };
+
+  void run();
+  bool isPlanned(long _frameIndex) const;
+  int findSlot(long _frameIndex) const;
+
+private:
+  ReadFunc m_read;
+  long m_rawFrameSize { };
+  long m_numFrames { };
+
+  std::vector<Slot> m_slots;
+
+  // read-ahead plan: frames m_planFirst + k*m_planStride, k < depth
+  long m_planFirst { };
+  long m_planStride { };
+  bool m_bPlanned { };
+
+  // access pattern
+  long m_lastFrame { -1 };
+  long m_lastStride { };
+
+  std::atomic<long> m_hits { };
+  std::atomic<long> m_misses { };
+
+  std::mutex m_mutex;
+  std::condition_variable m_cvWork;  // the plan changed or a slot got free
+  std::condition_variable m_cvReady; // a slot was read
+  bool m_bStop { };
+
+  std::thread m_thread;
+};
+}
+
+#endif
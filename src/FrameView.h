@@ -0,0 +1,133 @@
+/***************************************************************************
+ FrameView.h
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#ifndef FRAMEVIEW_H
+#define FRAMEVIEW_H
+
+#include <stdio.h>
+#include <memory>
+
+namespace jsIO {
+
+/**
+ * Read-only view of a frame, see jsFileReader::getFrameView.
+ * The traces and headers are stored in buffers owned by the reader (or in its memory-mapped extents).
+ * Views can be copied; the buffers stay valid as long as a view refers to them, also after the reader
+ * was closed, and are reused by the reader once the last view was released.
+ */
+class FrameView {
+  friend class jsFileReader;
+
+public:
+  FrameView() {}
+
+  ///@return true if the view refers to a frame
+  bool isValid() const {
+    return m_owner != NULL;
+  }
+  ///@return global index of the frame, -1 for an empty view
+  long getFrameIndex() const {
+    return m_frameIndex;
+  }
+  int getNumLiveTraces() const {
+    return m_numLiveTraces;
+  }
+  int getNumSamples() const {
+    return m_numSamples;
+  }
+  ///@return trace header length in bytes
+  int getNumBytesInHeader() const {
+    return m_headerLength;
+  }
+  ///@return samples of the live traces (getNumLiveTraces() * getNumSamples() floats), NULL if there are no live traces
+  const float *getTraces() const {
+    return m_traces;
+  }
+  ///@return headers of the live traces, NULL if the view was created without headers
+  const char *getHeaders() const {
+    return m_headers;
+  }
+  ///@return samples of the _i-th live trace
+  const float *getTrace(int _i) const {
+    return &m_traces[(long)_i * m_numSamples];
+  }
+  ///@return header of the _i-th live trace
+  const char *getHeader(int _i) const {
+    return (m_headers != NULL) ? &m_headers[(long)_i * m_headerLength] : NULL;
+  }
+  ///@brief Releases the buffers of the view (the view becomes empty)
+  void release() {
+    *this = FrameView();
+  }
+
+private:
+  std::shared_ptr<void> m_owner; // keeps the buffers alive
+  long m_frameIndex { -1 };
+  int m_numLiveTraces { };
+  int m_numSamples { };
+  int m_headerLength { };
+  const float *m_traces { };
+  const char *m_headers { };
+};
+
+/**
+ * Read-only view of a single live trace, see jsFileReader::getTraceView.
+ * It refers to the view of the frame which contains the trace.
+ */
+class TraceView {
+  friend class jsFileReader;
+
+public:
+  TraceView() {}
+
+  bool isValid() const {
+    return m_frame.isValid();
+  }
+  ///@return global index of the trace, -1 for an empty view
+  long getTraceIndex() const {
+    return m_traceIndex;
+  }
+  int getNumSamples() const {
+    return m_frame.getNumSamples();
+  }
+  const float *getTrace() const {
+    return m_frame.getTrace(m_traceInFrame);
+  }
+  ///@return header of the trace, NULL if the view was created without headers
+  const char *getHeader() const {
+    return m_frame.getHeader(m_traceInFrame);
+  }
+  ///@return the view of the frame which contains the trace
+  const FrameView &getFrameView() const {
+    return m_frame;
+  }
+  void release() {
+    *this = TraceView();
+  }
+
+private:
+  FrameView m_frame;
+  int m_traceInFrame { };
+  long m_traceIndex { -1 };
+};
+}
+
+#endif
@@ -0,0 +1,311 @@
+/***************************************************************************
+ IOBackend.cpp
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+#include "IOBackend.h"
+#include "PSProLogging.h"
+
+namespace jsIO {
+DECLARE_LOGGER(IOBackendLog);
+
+// preadv/pwritev, the requests of a batch are distributed over OpenMP threads
+class PreadBackend: public IOBackend {
+public:
+  PreadBackend(int _numThreads) :
+    m_numThreads(std::max(1, _numThreads)) {
+  }
+
+  int read(IORequest *_reqs, int _numReqs) {
+    return transfer(false, _reqs, _numReqs);
+  }
+
+  int write(IORequest *_reqs, int _numReqs) {
+    return transfer(true, _reqs, _numReqs);
+  }
+
+  JS_IO_BACKEND getType() const {
+    return JS_IO_PREAD;
+  }
+
+private:
+  int transfer(bool _write, IORequest *_reqs, int _numReqs);
+
+  int m_numThreads { };
+};
+
+// the io_uring backend needs the kernel headers of Linux 5.4 or newer, otherwise only the pread backend is built
+#if defined(IORING_FEAT_SINGLE_MMAP) && defined(__NR_io_uring_setup)
+#define JS_IO_URING_SUPPORTED
+#endif
+
+#ifdef JS_IO_URING_SUPPORTED
+// io_uring driven by the raw system calls, one ring used by one batch at a time
+class IOUringBackend: public IOBackend {
+public:
+  IOUringBackend(int _queueDepth);
+  ~IOUringBackend();
+
+  bool isValid() const {
+    return m_ringFd >= 0;
+  }
+
+  int read(IORequest *_reqs, int _numReqs) {
+    return transfer(false, _reqs, _numReqs);
+  }
+
+  int write(IORequest *_reqs, int _numReqs) {
+    return transfer(true, _reqs, _numReqs);
+  }
+
+  JS_IO_BACKEND getType() const {
+    return JS_IO_URING;
+  }
+
+private:
+  int transfer(bool _write, IORequest *_reqs, int _numReqs);
+
+  int m_ringFd { -1 };
+  unsigned m_numEntries { };
+  void *m_sqRing { MAP_FAILED };
+  size_t m_sqRingSize { };
+  void *m_cqRing { MAP_FAILED };
+  size_t m_cqRingSize { };
+  struct io_uring_sqe *m_sqes { (struct io_uring_sqe*)MAP_FAILED };
+  size_t m_sqesSize { };
+
+  unsigned *m_sqHead { };
+  unsigned *m_sqTail { };
+  unsigned *m_sqMask { };
+  unsigned *m_sqArray { };
+  unsigned *m_cqHead { };
+  unsigned *m_cqTail { };
+  unsigned *m_cqMask { };
+  struct io_uring_cqe *m_cqes { };
+
+  std::mutex m_mutex;
+};
+#endif
+
+IOBackend *IOBackend::create(JS_IO_BACKEND _type, int _queueDepth, int _numThreads) {
+  if(_type == JS_IO_URING) {
+#ifdef JS_IO_URING_SUPPORTED
+    IOUringBackend *backend = new IOUringBackend(std::max(1, _queueDepth));
+    if(backend->isValid()) return backend;
+    TRACE_PRINTF(IOBackendLog, "io_uring is not available (%s), use pread", strerror(errno));
+    delete backend;
+#else
+    TRACE_PRINTF(IOBackendLog, "jseisIO was built without io_uring support, use pread");
+#endif
+  }
+  return new PreadBackend(_numThreads);
+}
+
+bool IOBackend::advance(IORequest &_req, long _bytes) {
+  _req.offset += _bytes;
+  while(_req.iovcnt > 0 && (size_t)_bytes >= _req.iov->iov_len) {
+    _bytes -= _req.iov->iov_len;
+    _req.iov++;
+    _req.iovcnt--;
+  }
+  if(_req.iovcnt > 0) {
+    _req.iov->iov_base = (char*)_req.iov->iov_base + _bytes;
+    _req.iov->iov_len -= _bytes;
+  }
+  return _req.iovcnt == 0;
+}
+
+bool IOBackend::transferFull(bool _write, IORequest &_req) {
+  while(_req.iovcnt > 0) {
+    int iovcnt = std::min(_req.iovcnt, IOV_MAX);
+    ssize_t ret = _write ? ::pwritev(_req.fd, _req.iov, iovcnt, _req.offset) : ::preadv(_req.fd, _req.iov, iovcnt, _req.offset);
+    if(ret < 0) {
+      if(errno == EINTR) continue;
+      return false;
+    }
+    if(ret == 0) { // end of file
+      if(_write) return false;
+      for(int i = 0; i < _req.iovcnt; i++)
+        memset(_req.iov[i].iov_base, 0, _req.iov[i].iov_len);
+      _req.iovcnt = 0;
+      return true;
+    }
+    advance(_req, ret);
+  }
+  return true;
+}
+
+int PreadBackend::transfer(bool _write, IORequest *_reqs, int _numReqs) {
+  int ires = JS_OK;
+#pragma omp parallel for num_threads(m_numThreads) schedule(dynamic)
+  for(int i = 0; i < _numReqs; i++) {
+    if(!transferFull(_write, _reqs[i])) {
+#pragma omp critical
+      ires = JS_WARNING;
+    }
+  }
+  return ires;
+}
+
+#ifdef JS_IO_URING_SUPPORTED
+IOUringBackend::IOUringBackend(int _queueDepth) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  m_ringFd = syscall(__NR_io_uring_setup, _queueDepth, &params);
+  if(m_ringFd < 0) return;
+
+  m_numEntries = params.sq_entries;
+  m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool bSingleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if(bSingleMmap) m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+  m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+  if(m_sqRing != MAP_FAILED)
+    m_cqRing = bSingleMmap ? m_sqRing
+        : mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+  m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  if(m_cqRing != MAP_FAILED)
+    m_sqes = (struct io_uring_sqe*)mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd,
+                                        IORING_OFF_SQES);
+  if(m_sqes == MAP_FAILED) {
+    ERROR_PRINTF(IOBackendLog, "Can't map the io_uring queues: %s", strerror(errno));
+    ::close(m_ringFd); // the destructor unmaps the rest
+    m_ringFd = -1;
+    return;
+  }
+
+  char *sq = (char*)m_sqRing;
+  m_sqHead = (unsigned*)(sq + params.sq_off.head);
+  m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+  m_sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+  m_sqArray = (unsigned*)(sq + params.sq_off.array);
+  char *cq = (char*)m_cqRing;
+  m_cqHead = (unsigned*)(cq + params.cq_off.head);
+  m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+  m_cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+  m_cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+}
+
+IOUringBackend::~IOUringBackend() {
+  if(m_sqes != MAP_FAILED) munmap(m_sqes, m_sqesSize);
+  if(m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) munmap(m_cqRing, m_cqRingSize);
+  if(m_sqRing != MAP_FAILED) munmap(m_sqRing, m_sqRingSize);
+  if(m_ringFd >= 0) ::close(m_ringFd);
+}
+
+int IOUringBackend::transfer(bool _write, IORequest *_reqs, int _numReqs) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::deque<int> ready;
+  for(int i = 0; i < _numReqs; i++)
+    if(_reqs[i].iovcnt > 0) ready.push_back(i);
+
+  unsigned inFlight = 0;  // submitted to the ring and not completed
+  unsigned unsubmitted = 0; // in the ring but not consumed by the kernel yet
+  bool bFailed = false;
+  bool bRingFailed = false; // io_uring_enter failed, the rest is transferred with preadv/pwritev
+  while(inFlight > 0 || (!bFailed && !bRingFailed && !ready.empty())) {
+    // partially transferred requests are queued again with their rest
+    unsigned tail = *m_sqTail;
+    while(!bFailed && !bRingFailed && !ready.empty() && inFlight < m_numEntries) {
+      int i = ready.front();
+      ready.pop_front();
+      unsigned index = tail & *m_sqMask;
+      struct io_uring_sqe *sqe = &m_sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = _write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->fd = _reqs[i].fd;
+      sqe->addr = (unsigned long)_reqs[i].iov;
+      sqe->len = std::min(_reqs[i].iovcnt, IOV_MAX);
+      sqe->off = _reqs[i].offset;
+      sqe->user_data = i;
+      m_sqArray[index] = index;
+      tail++;
+      unsubmitted++;
+      inFlight++;
+    }
+    __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+
+    int ret = syscall(__NR_io_uring_enter, m_ringFd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if(ret < 0) {
+      if(errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+      if(!bRingFailed) {
+        ERROR_PRINTF(IOBackendLog, "io_uring_enter failed: %s, continue with %s", strerror(errno), _write ? "pwritev" : "preadv");
+        bRingFailed = true;
+        // the entries not consumed by the kernel are taken back. The submitted ones still use the buffers,
+        // so they are waited for below before the rest is transferred
+        unsigned sqHead = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        for(unsigned k = sqHead; k != tail; k++)
+          ready.push_back(m_sqes[m_sqArray[k & *m_sqMask]].user_data);
+        __atomic_store_n(m_sqTail, sqHead, __ATOMIC_RELEASE);
+        inFlight -= tail - sqHead;
+        unsubmitted = 0;
+      } else {
+        sched_yield(); // can't wait in the kernel, poll the completion queue
+      }
+    } else {
+      unsubmitted -= ret;
+    }
+
+    unsigned head = *m_cqHead;
+    unsigned cqTail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    for(; head != cqTail; head++) {
+      struct io_uring_cqe *cqe = &m_cqes[head & *m_cqMask];
+      int i = cqe->user_data;
+      int res = cqe->res;
+      inFlight--;
+      if(res == -EINTR || res == -EAGAIN) {
+        ready.push_back(i);
+      } else if(res < 0 || (res == 0 && _write)) {
+        TRACE_PRINTF(IOBackendLog, "Can't transfer at offset %ld: %s", _reqs[i].offset, strerror(-res));
+        bFailed = true;
+      } else if(res == 0) { // end of file
+        for(int k = 0; k < _reqs[i].iovcnt; k++)
+          memset(_reqs[i].iov[k].iov_base, 0, _reqs[i].iov[k].iov_len);
+        _reqs[i].iovcnt = 0;
+      } else if(!advance(_reqs[i], res)) {
+        ready.push_back(i);
+      }
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  // nothing is in flight any more, so the rest can be transferred directly
+  for(; bRingFailed && !ready.empty(); ready.pop_front()) {
+    if(!transferFull(_write, _reqs[ready.front()])) bFailed = true;
+  }
+  return bFailed ? JS_WARNING : JS_OK;
+}
+#endif
+}
@@ -0,0 +1,77 @@
+/***************************************************************************
+ IOBackend.h
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#ifndef IOBACKEND_H
+#define IOBACKEND_H
+
+#include <sys/uio.h>
+
+#include "jsDefs.h"
+
+namespace jsIO {
+
+/**
+ * One vectored transfer at _offset of the file _fd. The iovec array is consumed by the transfer.
+ */
+struct IORequest {
+  int fd;
+  struct iovec *iov;
+  int iovcnt;
+  long offset;
+};
+
+/**
+ * Executes batches of extent reads and writes. The pread backend runs the requests of a batch
+ * with preadv/pwritev on up to _numThreads OpenMP threads, the io_uring backend keeps up to
+ * _queueDepth requests of a batch in flight from the calling thread.
+ */
+class IOBackend {
+public:
+  virtual ~IOBackend() {
+  }
+
+  /*
+   * Reads all requests and returns when they are completed. The part beyond the end of file is zero-filled.
+   * return JS_OK if successful, JS_WARNING if a request failed
+   */
+  virtual int read(IORequest *_reqs, int _numReqs) = 0;
+
+  /*
+   * Writes all requests and returns when they are completed.
+   * return JS_OK if successful, JS_WARNING if a request failed
+   */
+  virtual int write(IORequest *_reqs, int _numReqs) = 0;
+
+  virtual JS_IO_BACKEND getType() const = 0;
+
+  // JS_IO_URING falls back to JS_IO_PREAD if io_uring is not supported by the system
+  static IOBackend *create(JS_IO_BACKEND _type, int _queueDepth, int _numThreads);
+
+  // blocking preadv/pwritev of one request, retried on partial transfers
+  static bool transferFull(bool _write, IORequest &_req);
+
+protected:
+  // advances the request by _bytes transferred bytes, returns true if the request is complete
+  static bool advance(IORequest &_req, long _bytes);
+};
+}
+
+#endif
@@ -21,92 +21,186 @@
 
 #include "IOCachedReader.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <csignal>
+#include <algorithm>
+#include <new>
 
 #include "PSProLogging.h"
-#include "FileUtil.h"
 #include "Assertion.h"
+#include "SharedBlockCache.h"
+#include "DirectIO.h"
 
 namespace jsIO {
 DECLARE_LOGGER(IOCachedReaderLog);
 
-IOCachedReader::IOCachedReader(const int _fileDescriptor, unsigned long _bufferSize, unsigned long _fileSize) : m_ulDebugReadCounter(0), m_ulBufferSize(
-    _bufferSize), m_ulBufferOffset(0), m_ulFileSize(_fileSize), m_nFileDescriptor(_fileDescriptor), m_bufferOffsetInit(false), m_pBuffer(
-NULL)
-
-{
-  m_pBuffer = new unsigned char[m_ulBufferSize];
+IOCachedReader::IOCachedReader(unsigned long _pageSize, int _numPages, JS_CACHE_POLICY _policy) :
+  m_ulPageSize(_pageSize), m_numPages(_numPages), m_policy(_policy), m_nFileDescriptor(-1) {
+  if(m_ulPageSize == 0 || m_numPages <= 0) {
+    m_ulPageSize = 0;
+    m_numPages = 0;
+    return;
+  }
+  // aligned, so the pages can be read in place with O_DIRECT
+  if(posix_memalign((void**)&m_pBuffer, DIRECT_IO_ALIGNMENT, m_ulPageSize * m_numPages) != 0) throw std::bad_alloc();
+  m_pages.resize(m_numPages);
+  for(int i = 0; i < m_numPages; i++) {
+    m_pages[i].key = -1;
+    m_pages[i].length = 0;
+    m_pages[i].prev = i - 1;
+    m_pages[i].next = (i + 1 < m_numPages) ? i + 1 : -1;
+    m_pages[i].referenced = false;
+  }
+  m_head = 0;
+  m_tail = m_numPages - 1;
+  m_index.reserve(m_numPages);
 }
 
 IOCachedReader::~IOCachedReader() {
-  delete[] m_pBuffer;
+  free(m_pBuffer);
 }
 
-bool IOCachedReader::setNewFile(const int _fileDescriptor, unsigned long _fileSize) {
+bool IOCachedReader::setNewFile(const int _fileDescriptor, unsigned long _fileSize, int _fileKey, int _directFd) {
   m_nFileDescriptor = _fileDescriptor;
+  m_nDirectFd = _directFd;
   m_ulFileSize = _fileSize;
-  m_ulDebugReadCounter = 0;
-  m_ulBufferOffset = 0;
-  m_bufferOffsetInit = false;
+  m_fileKey = _fileKey;
   return true;
 }
 
+void IOCachedReader::resetStats() {
+  m_stats = JS_CACHE_STATS();
+}
+
 bool IOCachedReader::read(unsigned long _offset, unsigned char *_buffer, long _bufferSize) {
-  unsigned long length = _bufferSize;
-  unsigned long offset = 0;
-  unsigned long readSize = 0;
   assertion(m_ulFileSize > 0, "m_ulFileSize=%lu", m_ulFileSize);
-  if(m_ulBufferSize == 0) {
-    // unsigned long actRead = ::pread(m_nFileDescriptor, _buffer, _bufferSize, _offset);
-    unsigned long actRead = wrapIOFull(pread, m_nFileDescriptor, _buffer, _bufferSize, _offset);
-#if 1
-    assertion(actRead == _bufferSize, "actRead=%lu, bufferSize=%lu does not match!", actRead, _bufferSize);
-#else // for debugger tracing
-    if(actRead != _bufferSize) {
-      abort();
-      return false;
-    }
-#endif
-  } else {
-    while(length > 0) {
-#if 1
-      assertion(!(m_ulFileSize - m_ulBufferOffset == 0 || length > _bufferSize),
-                "m_ulFileSize=%lu, m_ulBufferOffset=%lu, length=%lu, _bufferSize=%lu", m_ulFileSize, m_ulBufferOffset, length, _bufferSize);
-#else // for debugger tracing
-      if(m_ulFileSize - m_ulBufferOffset == 0 || length > _bufferSize) {
-        TRACE_VAR4(IOCachedReaderLog, length, m_ulBufferSize, m_ulBufferOffset, _offset);
-        abort();
-        return false;
-      }
-#endif
-      if(m_bufferOffsetInit == false || _offset < m_ulBufferOffset || _offset >= m_ulBufferOffset + m_ulBufferSize) { // outside
-        m_bufferOffsetInit = true;
-        m_ulBufferOffset = _offset;
-        m_ulDebugReadCounter++;
-        readSize = std::min(m_ulBufferSize, m_ulFileSize - m_ulBufferOffset);
-        //unsigned long actRead = ::pread(m_nFileDescriptor, m_pBuffer, readSize, m_ulBufferOffset);
-        unsigned long actRead = wrapIOFull(pread, m_nFileDescriptor, m_pBuffer, readSize, m_ulBufferOffset);
-        if(actRead != readSize) {
-          m_bufferOffsetInit = false;
-          return false;
-        }
-      } else if(_offset >= m_ulBufferOffset && _offset + length < m_ulBufferOffset + m_ulBufferSize) { // inside
-        memcpy(_buffer + offset, m_pBuffer + (_offset - m_ulBufferOffset), length);
-        length = 0;
-      } else { // right side
-        memcpy(_buffer + offset, m_pBuffer + _offset - m_ulBufferOffset, m_ulBufferOffset + m_ulBufferSize - _offset);
-        offset += m_ulBufferOffset + m_ulBufferSize - _offset;
-        length = _offset + length - (m_ulBufferOffset + m_ulBufferSize);
-        _offset = m_ulBufferOffset + m_ulBufferSize;
-      }
+  // the reserved space of a compressed frame may extend beyond the end of the extent file
+  unsigned long length = _bufferSize;
+  if(_offset + length > m_ulFileSize) {
+    unsigned long inFile = (_offset < m_ulFileSize) ? m_ulFileSize - _offset : 0;
+    memset(_buffer + inFile, 0, length - inFile);
+    length = inFile;
+  }
+
+  unsigned long pageSize = (m_pShared != NULL) ? m_pShared->getBlockSize() : m_ulPageSize;
+  if(pageSize == 0 || (unsigned long)_bufferSize >= pageSize) {
+    m_stats.directReads++;
+    unsigned long actRead = preadDirect(m_nDirectFd, m_nFileDescriptor, _buffer, length, _offset);
+    if(actRead != length) return false;
+    m_stats.bytesRead += actRead;
+    return true;
+  }
+  if(m_pShared != NULL) return m_pShared->read(m_fileKey, m_nFileDescriptor, m_ulFileSize, _offset, _buffer, length, m_stats);
+
+  while(length > 0) {
+    unsigned long pageNo = _offset / m_ulPageSize;
+    unsigned long inPage = _offset - pageNo * m_ulPageSize;
+    long key = ((long)m_fileKey << 40) | (long)pageNo;
+    int slot = findPage(key);
+    if(slot >= 0) {
+      m_stats.hits++;
+      touch(slot);
+    } else {
+      slot = loadPage(key, pageNo * m_ulPageSize);
+      if(slot < 0) return false;
     }
+    const Page &page = m_pages[slot];
+    unsigned long n = std::min(length, page.length - inPage);
+    memcpy(_buffer, m_pBuffer + slot * m_ulPageSize + inPage, n);
+    _buffer += n;
+    _offset += n;
+    length -= n;
   }
   return true;
 }
 
+int IOCachedReader::findPage(long _key) const {
+  std::unordered_map<long, int>::const_iterator it = m_index.find(_key);
+  return (it != m_index.end()) ? it->second : -1;
+}
+
+int IOCachedReader::loadPage(long _key, unsigned long _pageOffset) {
+  int slot = victim();
+  Page &page = m_pages[slot];
+  if(page.key >= 0) {
+    m_index.erase(page.key);
+    m_stats.evictions++;
+  }
+  page.key = -1;
+  page.length = 0;
+
+  unsigned long readSize = std::min(m_ulPageSize, m_ulFileSize - _pageOffset);
+  m_stats.misses++;
+  unsigned long actRead = preadDirect(m_nDirectFd, m_nFileDescriptor, m_pBuffer + slot * m_ulPageSize, readSize, _pageOffset);
+  if(actRead != readSize) {
+    TRACE_PRINTF(IOCachedReaderLog, "Can't read %lu bytes at offset %lu", readSize, _pageOffset);
+    pushBack(slot); // reuse the slot first
+    return -1;
+  }
+  m_stats.bytesRead += actRead;
+  page.key = _key;
+  page.length = readSize;
+  m_index[_key] = slot;
+  touch(slot);
+  return slot;
+}
+
+// slot of the page to replace, free slots are taken first by both policies
+int IOCachedReader::victim() {
+  if(m_policy == JS_CACHE_CLOCK) {
+    while(m_pages[m_clockHand].referenced) {
+      m_pages[m_clockHand].referenced = false;
+      m_clockHand = (m_clockHand + 1) % m_numPages;
+    }
+    int slot = m_clockHand;
+    m_clockHand = (m_clockHand + 1) % m_numPages;
+    return slot;
+  }
+  return m_tail;
+}
+
+void IOCachedReader::touch(int _slot) {
+  if(m_policy == JS_CACHE_CLOCK) {
+    m_pages[_slot].referenced = true;
+  } else if(m_head != _slot) {
+    unlink(_slot);
+    pushFront(_slot);
+  }
+}
+
+void IOCachedReader::unlink(int _slot) {
+  Page &page = m_pages[_slot];
+  if(page.prev >= 0) m_pages[page.prev].next = page.next;
+  else m_head = page.next;
+  if(page.next >= 0) m_pages[page.next].prev = page.prev;
+  else m_tail = page.prev;
+  page.prev = page.next = -1;
+}
+
+void IOCachedReader::pushFront(int _slot) {
+  m_pages[_slot].prev = -1;
+  m_pages[_slot].next = m_head;
+  if(m_head >= 0) m_pages[m_head].prev = _slot;
+  m_head = _slot;
+  if(m_tail < 0) m_tail = _slot;
 }
 
+void IOCachedReader::pushBack(int _slot) {
+  if(m_policy == JS_CACHE_CLOCK) {
+    m_pages[_slot].referenced = false;
+    return;
+  }
+  if(m_tail == _slot) return;
+  unlink(_slot);
+  m_pages[_slot].next = -1;
+  m_pages[_slot].prev = m_tail;
+  if(m_tail >= 0) m_pages[m_tail].next = _slot;
+  m_tail = _slot;
+  if(m_head < 0) m_head = _slot;
+}
+
+}
@@ -22,29 +22,81 @@
 #ifndef IOCACHEDREADER_H
 #define IOCACHEDREADER_H
 
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "jsDefs.h"
+
 namespace jsIO {
+
+class SharedBlockCache;
+
+/**
+ * Page cache for reading extent files.
+ * The files are read in pages of a fixed size; up to numPages pages are kept and replaced by the given
+ * policy (LRU or CLOCK). Pages are keyed by the file key passed to setNewFile (the extent index), so
+ * switching between extents does not drop the pages of the other extents.
+ * Reads of a page size or more are not cached and go directly to the file. Bytes beyond the end of
+ * the file are returned as zeros. With an O_DIRECT descriptor the reads bypass the system page cache.
+ * If a SharedBlockCache is set, its blocks are used instead of the own pages and the file keys must
+ * be obtained from SharedBlockCache::getFileId.
+ */
 class IOCachedReader {
 public:
-  IOCachedReader(const int _fileDescriptor, unsigned long _bufferSize, unsigned long _fileSize);
+  IOCachedReader(unsigned long _pageSize, int _numPages, JS_CACHE_POLICY _policy = JS_CACHE_LRU);
   ~IOCachedReader();
   bool read(unsigned long _offset, unsigned char *_buffer, long _bufferSize);
-  bool setNewFile(const int _fileDescriptor, unsigned long _fileSize);
+  // _directFd is an O_DIRECT descriptor of the same file, or -1 to read through the system page cache
+  bool setNewFile(const int _fileDescriptor, unsigned long _fileSize, int _fileKey = 0, int _directFd = -1);
+
+  void setSharedCache(const std::shared_ptr<SharedBlockCache> &_shared) {
+    m_pShared = _shared;
+  }
+
+  const JS_CACHE_STATS &getStats() const {
+    return m_stats;
+  }
+  void resetStats();
 
   // When enabled, the IOCachedReader will make the system disk cache not cache again what it has read itself
   //     static void enableFileUncache(bool _enable);
 
-  unsigned long m_ulDebugReadCounter {};
 private:
-  unsigned long m_ulBufferSize {};
-  unsigned long m_ulUnitSize {};
-  unsigned long m_ulBufferOffset {};
+  struct Page {
+    long key;
+    unsigned long length; // valid bytes, less than the page size at the end of a file
+    int prev, next;       // LRU list, most recently used first
+    bool referenced;      // CLOCK reference bit
+  };
+
+  int findPage(long _key) const;
+  int loadPage(long _key, unsigned long _pageOffset);
+  int victim();
+  void touch(int _slot);
+  void unlink(int _slot);
+  void pushFront(int _slot);
+  void pushBack(int _slot);
+
+private:
+  unsigned long m_ulPageSize {};
+  int m_numPages {};
+  JS_CACHE_POLICY m_policy {};
   unsigned long m_ulFileSize {};
   int m_nFileDescriptor {};
-  bool m_bufferOffsetInit {};
+  int m_nDirectFd { -1 };
+  int m_fileKey {};
   unsigned char *m_pBuffer {};
+  std::vector<Page> m_pages;
+  std::unordered_map<long, int> m_index; // page key -> slot
+  int m_head {};
+  int m_tail {};
+  int m_clockHand {};
+  JS_CACHE_STATS m_stats {};
+  std::shared_ptr<SharedBlockCache> m_pShared;
   //     static bool s_uncacheEnabled;
   //     FileUncache m_fUncache;
 };
 }
 
-#endif /* IOREADERHELPER_H_ */
+#endif /* IOCACHEDREADER_H */
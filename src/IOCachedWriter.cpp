@@ -22,42 +22,50 @@
 #include "IOCachedWriter.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <algorithm>
+#include <new>
 
 #include "PSProLogging.h"
-#include "FileUtil.h"
+#include "DirectIO.h"
 
 namespace jsIO {
 DECLARE_LOGGER(IOCachedWriterLog);
 
 IOCachedWriter::IOCachedWriter(const int _fileDescriptor, unsigned long _bufferSize) :
-  m_ulBufferSize(_bufferSize), m_ulBufferOffsetBegin(0), m_ulBufferOffsetEnd(0), m_nFileDescriptor(_fileDescriptor), m_pBuffer(
-    NULL) {
-  m_pBuffer = new unsigned char[_bufferSize];
+  m_ulBufferSize(_bufferSize), m_ulBufferOffsetBegin(0), m_ulBufferOffsetEnd(0), m_nFileDescriptor(_fileDescriptor), m_nDirectFd(
+    -1), m_pBuffer(NULL) {
+  // aligned, so the buffer can be written in place with O_DIRECT
+  if(posix_memalign((void**)&m_pBuffer, DIRECT_IO_ALIGNMENT, std::max(_bufferSize, 1UL)) != 0) throw std::bad_alloc();
 }
 
-bool IOCachedWriter::setNewFileDescriptor(const int _fileDescriptor) {
-  flush();
+bool IOCachedWriter::setNewFileDescriptor(const int _fileDescriptor, const int _directFd) {
+  bool res = flush();
   m_nFileDescriptor = _fileDescriptor;
+  m_nDirectFd = _directFd;
   m_ulBufferOffsetBegin = 0;
   m_ulBufferOffsetEnd = 0;
-  return true;
+  return res;
 }
 
 IOCachedWriter::~IOCachedWriter() {
-  if(m_pBuffer != NULL) delete[] m_pBuffer;
+  free(m_pBuffer);
 }
 
 bool IOCachedWriter::flush() {
   //   if(m_nFileDescriptor<0) return true;
   long writeSize = m_ulBufferOffsetEnd - m_ulBufferOffsetBegin;
+  if(writeSize <= 0) return true;
   // if (::pwrite(m_nFileDescriptor, m_pBuffer, writeSize, m_ulBufferOffsetBegin) != writeSize) {
-  if(wrapIOFull(pwrite, m_nFileDescriptor, m_pBuffer, writeSize, m_ulBufferOffsetBegin) != writeSize) {
+  if(pwriteDirect(m_nDirectFd, m_nFileDescriptor, m_pBuffer, writeSize, m_ulBufferOffsetBegin) != writeSize) {
     return false;
   }
+  // buffer is empty now, the next sequential write continues at m_ulBufferOffsetEnd
+  m_ulBufferOffsetBegin = m_ulBufferOffsetEnd;
   return true;
 }
 
@@ -66,8 +74,10 @@ bool IOCachedWriter::write(unsigned long _offset, unsigned char *_buffer, unsign
   long writtenBytes = 0;
   bool firstCheck = true;
   if(m_ulBufferSize == 0 || _bufferLen > m_ulBufferSize) {
+    // write out what is still cached, otherwise it gets lost
+    if(!flush()) return false;
     // if (::pwrite(m_nFileDescriptor, _buffer, _bufferLen, _offset) != _bufferLen) {
-    if(wrapIOFull(pwrite, m_nFileDescriptor, _buffer, _bufferLen, _offset) != _bufferLen) {
+    if(pwriteDirect(m_nDirectFd, m_nFileDescriptor, _buffer, _bufferLen, _offset) != _bufferLen) {
       return false;
     }
     m_ulBufferOffsetBegin = 0;
@@ -78,7 +88,7 @@ bool IOCachedWriter::write(unsigned long _offset, unsigned char *_buffer, unsign
         if(m_ulBufferOffsetEnd - m_ulBufferOffsetBegin > 0) {
           long writeSize = m_ulBufferOffsetEnd - m_ulBufferOffsetBegin;
           // if (::pwrite(m_nFileDescriptor, m_pBuffer, writeSize, m_ulBufferOffsetBegin) != writeSize) {
-          if(wrapIOFull(pwrite, m_nFileDescriptor, m_pBuffer, writeSize, m_ulBufferOffsetBegin) != writeSize) {
+          if(pwriteDirect(m_nDirectFd, m_nFileDescriptor, m_pBuffer, writeSize, m_ulBufferOffsetBegin) != writeSize) {
             return false;
           }
         }
@@ -92,7 +102,7 @@ bool IOCachedWriter::write(unsigned long _offset, unsigned char *_buffer, unsign
           writtenBytes += m_ulBufferOffsetBegin + m_ulBufferSize - m_ulBufferOffsetEnd;
           memcpy(m_pBuffer + (m_ulBufferOffsetEnd - m_ulBufferOffsetBegin), _buffer, writtenBytes);
           // if (::pwrite(m_nFileDescriptor, m_pBuffer, m_ulBufferSize, m_ulBufferOffsetBegin) != m_ulBufferSize) {
-          if(wrapIOFull(pwrite, m_nFileDescriptor, m_pBuffer, m_ulBufferSize, m_ulBufferOffsetBegin) != m_ulBufferSize) {
+          if(pwriteDirect(m_nDirectFd, m_nFileDescriptor, m_pBuffer, m_ulBufferSize, m_ulBufferOffsetBegin) != m_ulBufferSize) {
             return false;
           }
 
@@ -36,7 +36,8 @@ public:
    */
   bool write(unsigned long _offset, unsigned char *_buffer, unsigned long _bufferLen);
 
-  bool setNewFileDescriptor(const int _fileDescriptor);
+  // _directFd is an O_DIRECT descriptor of the same file, or -1 to write through the system page cache
+  bool setNewFileDescriptor(const int _fileDescriptor, const int _directFd = -1);
 
   bool flush();
 
@@ -46,6 +47,7 @@ private:
   unsigned long m_ulBufferOffsetEnd;
   unsigned long m_ulFileSize;
   int m_nFileDescriptor;
+  int m_nDirectFd;
   unsigned char *m_pBuffer;
 };
 
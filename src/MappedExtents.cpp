@@ -0,0 +1,98 @@
+/***************************************************************************
+ MappedExtents.cpp
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "MappedExtents.h"
+#include "ExtentList.h"
+#include "PSProLogging.h"
+
+namespace jsIO {
+DECLARE_LOGGER(MappedExtentsLog);
+
+MappedExtents::MappedExtents(ExtentList *_extents, JS_ACCESS_PATTERN _access) :
+  m_extents(_extents), m_access(_access) {
+  int numExtents = m_extents->getNumExtents();
+  m_addr.assign(numExtents, NULL);
+  m_size.assign(numExtents, 0);
+}
+
+MappedExtents::~MappedExtents() {
+  for(size_t i = 0; i < m_addr.size(); i++) {
+    if(m_addr[i] != NULL) ::munmap(m_addr[i], m_size[i]);
+  }
+}
+
+const char *MappedExtents::getPointer(long _offset, long _len) {
+  // same convention as jsFileReader::readTraceBuffer
+  int extInd = m_extents->getExtentIndex(_offset + 1);
+  if(extInd < 0 || extInd != m_extents->getExtentIndex(_offset + _len)) return NULL;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if(m_addr[extInd] == NULL && !mapExtent(extInd)) return NULL;
+
+  long locOffset = _offset - (*m_extents)[extInd].getStartOffset();
+  if(locOffset + _len > m_size[extInd]) return NULL;
+  return m_addr[extInd] + locOffset;
+}
+
+void MappedExtents::setAccessPattern(JS_ACCESS_PATTERN _access) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_access = _access;
+  for(size_t i = 0; i < m_addr.size(); i++) {
+    if(m_addr[i] != NULL) advise(i);
+  }
+}
+
+bool MappedExtents::mapExtent(int _extInd) {
+  std::string fname = (*m_extents)[_extInd].getPath();
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if(fd < 0) {
+    TRACE_PRINTF(MappedExtentsLog, "Can't open extent %s", fname.c_str());
+    return false;
+  }
+  struct stat st;
+  if(::fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+  void *addr = ::mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd); // the mapping keeps the file referenced
+  if(addr == MAP_FAILED) {
+    ERROR_PRINTF(MappedExtentsLog, "Can't map extent %s (%ld bytes)", fname.c_str(), (long)st.st_size);
+    return false;
+  }
+  m_addr[_extInd] = (char *)addr;
+  m_size[_extInd] = st.st_size;
+  advise(_extInd);
+  TRACE_PRINTF(MappedExtentsLog, "Mapped extent %s (%ld bytes)", fname.c_str(), (long)st.st_size);
+  return true;
+}
+
+void MappedExtents::advise(int _extInd) {
+  int advice = MADV_NORMAL;
+  if(m_access == JS_ACCESS_SEQUENTIAL) advice = MADV_SEQUENTIAL;
+  else if(m_access == JS_ACCESS_RANDOM) advice = MADV_RANDOM;
+  ::madvise(m_addr[_extInd], m_size[_extInd], advice);
+}
+}
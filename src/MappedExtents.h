@@ -0,0 +1,66 @@
+/***************************************************************************
+ MappedExtents.h
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#ifndef MAPPEDEXTENTS_H
+#define MAPPEDEXTENTS_H
+
+#include <vector>
+#include <mutex>
+
+#include "jsDefs.h"
+
+namespace jsIO {
+
+class ExtentList;
+
+/**
+ * Read-only memory mappings of the extent files of an ExtentList (TraceFile or TraceHeaders).
+ * An extent is mapped on its first access and stays mapped until the object is deleted.
+ * getPointer may be called from several threads.
+ */
+class MappedExtents {
+public:
+  MappedExtents(ExtentList *_extents, JS_ACCESS_PATTERN _access);
+  ~MappedExtents();
+
+  /*
+   * Returns a pointer to _len bytes at the global offset _offset, or NULL if the range
+   * is not located in one extent or lies beyond the end of the extent file.
+   */
+  const char *getPointer(long _offset, long _len);
+
+  // passes the access pattern to madvise for all current and future mappings
+  void setAccessPattern(JS_ACCESS_PATTERN _access);
+
+private:
+  bool mapExtent(int _extInd);
+  void advise(int _extInd);
+
+private:
+  ExtentList *m_extents { };
+  JS_ACCESS_PATTERN m_access { };
+  std::vector<char *> m_addr; // NULL if not mapped
+  std::vector<long> m_size;
+  std::mutex m_mutex;
+};
+}
+
+#endif
@@ -0,0 +1,234 @@
+/***************************************************************************
+ ReadContext.cpp
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+
+#include "ReadContext.h"
+#include "jsFileReader.h"
+#include "TraceProperties.h"
+#include "FileProperties.h"
+#include "ExtentList.h"
+#include "MappedExtents.h"
+#include "IOCachedReader.h"
+#include "SharedBlockCache.h"
+#include "compress/TraceCompressor.h"
+#include "compress/SeisPEG.h"
+#include "PSProLogging.h"
+
+namespace jsIO {
+DECLARE_LOGGER(ReadContextLog);
+
+ReadContext::ReadContext(jsFileReader *_reader) :
+  m_reader(_reader) {
+}
+
+ReadContext::~ReadContext() {
+  if(m_rawFrame != NULL) delete[] m_rawFrame;
+  if(m_traceBuffer != NULL) delete m_traceBuffer;
+  if(m_traceCompressor != NULL) delete m_traceCompressor;
+  if(m_seispegCompressor != NULL) delete m_seispegCompressor;
+  if(m_pCachedReaderTR != NULL) delete m_pCachedReaderTR;
+  if(m_pCachedReaderHD != NULL) delete m_pCachedReaderHD;
+  if(m_frame != NULL) delete[] m_frame;
+  if(m_frameHeader != NULL) delete[] m_frameHeader;
+}
+
+int ReadContext::init() {
+  jsFileReader *r = m_reader;
+  m_pCachedReaderTR = new IOCachedReader(r->m_IOPageSize, r->m_IONumPages, r->m_IOCachePolicy);
+  m_pCachedReaderHD = new IOCachedReader(r->m_IOPageSize, r->m_IONumPages, r->m_IOCachePolicy);
+  m_pCachedReaderTR->setSharedCache(r->m_pSharedCache);
+  m_pCachedReaderHD->setSharedCache(r->m_pSharedCache);
+
+  if(r->m_bIsFloat) return JS_OK; // FLOAT frames are read in place
+
+  m_rawFrame = new char[r->m_frameSize];
+  if(!r->m_bSeisPEG_data) {
+    m_traceBuffer = new CharBuffer();
+    m_traceBuffer->setByteOrder(r->m_byteOrder);
+    m_traceBuffer->wrap(m_rawFrame, r->m_frameSize);
+    m_traceCompressor = new TraceCompressor();
+    m_traceCompressor->Init(r->m_fileProps->traceFormat, r->m_numSamples, m_traceBuffer);
+    return JS_OK;
+  }
+
+  // the compression parameters are stored with every frame, take them from the first one
+  int ires = readBuffer(false, 0, m_rawFrame, r->m_frameSize);
+  if(ires != JS_OK) return ires;
+  m_seispegCompressor = new SeisPEG();
+  if(m_seispegCompressor->Init(m_rawFrame) != JS_OK) {
+    ERROR_PRINTF(ReadContextLog, "Invalid JavaSeis SeisPEG file");
+    return JS_USERERROR;
+  }
+  return JS_OK;
+}
+
+int ReadContext::readFrame(const long _frameIndex, float *frame, char *headbuf) {
+  jsFileReader *r = m_reader;
+  if(_frameIndex < 0 || _frameIndex >= r->m_TotalNumOfFrames) {
+    ERROR_PRINTF(ReadContextLog, "Invalid frame index. %ld must be in [0,%ld)\n", _frameIndex, r->m_TotalNumOfFrames);
+    return JS_USERERROR;
+  }
+  int numLiveTraces = r->getNumOfLiveTraces(_frameIndex);
+  if(numLiveTraces <= 0) return numLiveTraces;
+  bool bSwap = nativeOrder() != r->m_byteOrder;
+
+  if(headbuf != NULL && !r->m_bSeisPEG_data) {
+    int ires = readBuffer(true, _frameIndex * r->m_frameHeaderLength, headbuf, (long)numLiveTraces * r->m_headerLengthBytes);
+    if(ires != JS_OK) {
+      ERROR_PRINTF(ReadContextLog, "Can't read frame header from %s", r->m_filename.c_str());
+      return ires;
+    }
+    if(bSwap) r->m_traceProps->swapHeaders(headbuf, numLiveTraces);
+  }
+
+  // SeisPEG headers are stored with the traces
+  if(frame == NULL && headbuf != NULL && r->m_bSeisPEG_data) {
+    if(m_frame == NULL) m_frame = new float[(long)r->m_numSamples * r->m_numTraces];
+    m_frameInd = -1;
+    frame = m_frame;
+  }
+  if(frame == NULL) return numLiveTraces;
+
+  long bytesInFrame = (long)numLiveTraces * r->m_compess_traceSize;
+  char *rawframe = r->m_bIsFloat ? (char*)frame : m_rawFrame;
+  int ires = readBuffer(false, _frameIndex * r->m_frameSize, rawframe, bytesInFrame);
+  if(ires != JS_OK) {
+    ERROR_PRINTF(ReadContextLog, "Can't read frame from %s", r->m_filename.c_str());
+    return ires;
+  }
+  if(r->m_bIsFloat) {
+    if(bSwap) endian_swap((void*)frame, (long)numLiveTraces * r->m_numSamples, sizeof(float));
+  } else if(r->m_bSeisPEG_data) {
+    if(headbuf != NULL) {
+      m_seispegCompressor->uncompress(m_rawFrame, bytesInFrame, frame, numLiveTraces, (int*)headbuf, r->m_headerLengthWords);
+      if(bSwap) r->m_traceProps->swapHeaders(headbuf, numLiveTraces);
+    } else {
+      m_seispegCompressor->uncompress(m_rawFrame, bytesInFrame, frame, numLiveTraces);
+    }
+  } else {
+    m_traceCompressor->updateBuffer(m_rawFrame, r->m_frameSize);
+    m_traceCompressor->unpackFrame(numLiveTraces, frame);
+  }
+  return numLiveTraces;
+}
+
+int ReadContext::readFrameHeader(const long _frameIndex, char *headbuf) {
+  return readFrame(_frameIndex, NULL, headbuf);
+}
+
+int ReadContext::loadFrame(long _frameIndex, bool _withHeaders) {
+  if(m_frameInd == _frameIndex && (m_bFrameHeaders || !_withHeaders)) return m_numOfFrameLiveTraces;
+  jsFileReader *r = m_reader;
+  if(m_frame == NULL) m_frame = new float[(long)r->m_numSamples * r->m_numTraces];
+  if(_withHeaders && m_frameHeader == NULL) m_frameHeader = new char[r->m_frameHeaderLength];
+
+  m_frameInd = -1;
+  int numLiveTraces = readFrame(_frameIndex, m_frame, _withHeaders ? m_frameHeader : NULL);
+  if(numLiveTraces < 0) return numLiveTraces;
+  m_frameInd = _frameIndex;
+  m_numOfFrameLiveTraces = numLiveTraces;
+  m_bFrameHeaders = _withHeaders;
+  return numLiveTraces;
+}
+
+long ReadContext::readTraces(const long _firstTraceIndex, const long _numOfTraces, float *buffer, char *headbuf) {
+  jsFileReader *r = m_reader;
+  if(_firstTraceIndex < 0 || _numOfTraces < 0 || _firstTraceIndex + _numOfTraces > r->m_TotalNumOfTraces) {
+    ERROR_PRINTF(ReadContextLog, "Invalid trace range. [%ld,%ld) must be in [0,%ld)", _firstTraceIndex,
+                 _firstTraceIndex + _numOfTraces, r->m_TotalNumOfTraces);
+    return JS_USERERROR;
+  }
+
+  long nReadTraces = 0;
+  long trace = _firstTraceIndex;
+  long endTrace = _firstTraceIndex + _numOfTraces;
+  while(trace < endTrace) {
+    long frameInd = trace / r->m_numTraces;
+    int trInd = trace - frameInd * r->m_numTraces;
+    int numLiveTraces = loadFrame(frameInd, headbuf != NULL);
+    if(numLiveTraces < 0) return numLiveTraces;
+
+    // dead traces are skipped
+    long numTraces = std::min((long)numLiveTraces, trInd + endTrace - trace) - trInd;
+    if(numTraces > 0) {
+      memcpy(&buffer[nReadTraces * r->m_numSamples], &m_frame[(long)trInd * r->m_numSamples],
+             numTraces * r->m_numSamples * sizeof(float));
+      if(headbuf != NULL)
+        memcpy(&headbuf[nReadTraces * r->m_headerLengthBytes], &m_frameHeader[(long)trInd * r->m_headerLengthBytes],
+               numTraces * r->m_headerLengthBytes);
+      nReadTraces += numTraces;
+    }
+    trace += r->m_numTraces - trInd;
+  }
+  return nReadTraces;
+}
+
+//read _buflen bytes at the global offset _offset from the TraceFile(s) or TraceHeaders
+int ReadContext::readBuffer(bool _header, long _offset, char *_buf, long _buflen) {
+  jsFileReader *r = m_reader;
+  MappedExtents *mapped = _header ? r->m_pMappedHD.get() : r->m_pMappedTR.get();
+  if(mapped != NULL) {
+    const char *p = mapped->getPointer(_offset, _buflen);
+    if(p != NULL) {
+      memcpy(_buf, p, _buflen);
+      return JS_OK;
+    }
+  }
+
+  ExtentList *extents = _header ? r->m_TrHeadExtents : r->m_TrFileExtents;
+  IOCachedReader *cache = _header ? m_pCachedReaderHD : m_pCachedReaderTR;
+  int &currExtent = _header ? m_currIndexOfTrHeadExtent : m_currIndexOfTrFileExtent;
+
+  int lowInd = extents->getExtentIndex(_offset + 1);
+  int upInd = extents->getExtentIndex(_offset + _buflen);
+  if(lowInd < 0 || upInd < 0 || upInd < lowInd) {
+    ERROR_PRINTF(ReadContextLog, "Can't read %ld bytes starting from offset %ld", _buflen, _offset);
+    return JS_USERERROR;
+  }
+
+  long rest_buflen = _buflen;
+  long bytes2read = _buflen;
+  long loc_offset = _offset - (*extents)[lowInd].getStartOffset();
+  for(int extInd = lowInd; extInd <= upInd; extInd++) {
+    long extSize = (*extents)[extInd].getExtentSize();
+    if(loc_offset + rest_buflen > extSize) {
+      bytes2read = extSize - loc_offset;
+    }
+    if(currExtent != extInd) {
+      int fd = r->getSharedFd(_header, extInd);
+      if(fd < 0) return JS_WARNING;
+      int fileKey = (r->m_pSharedCache != NULL) ? r->m_pSharedCache->getFileId((*extents)[extInd].getPath()) : extInd;
+      cache->setNewFile(fd, (*extents)[extInd].getExtentSizeOnDisk(), fileKey, r->getSharedFd(_header, extInd, true));
+      currExtent = extInd;
+    }
+    if(!cache->read(loc_offset, (unsigned char*)&_buf[_buflen - rest_buflen], bytes2read)) {
+      currExtent = -1;
+      return JS_WARNING;
+    }
+    rest_buflen -= bytes2read;
+    bytes2read = rest_buflen;
+    loc_offset = 0;
+  }
+  return JS_OK;
+}
+}
@@ -0,0 +1,101 @@
+/***************************************************************************
+ ReadContext.h
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#ifndef READCONTEXT_H
+#define READCONTEXT_H
+
+#include <stdio.h>
+
+namespace jsIO {
+
+class jsFileReader;
+class CharBuffer;
+class TraceCompressor;
+class SeisPEG;
+class IOCachedReader;
+
+/**
+ * Per-thread read state of a jsFileReader, see jsFileReader::createReadContext.
+ * The metadata of the dataset (properties, extents, trace map) and the file descriptors are shared with the
+ * reader, while buffers, decompressors and read caches belong to the context. Several threads can therefore
+ * read one dataset concurrently through one reader, each thread with its own context.
+ * A context must not be used by several threads at the same time and must be deleted before its reader is
+ * closed. The reader's configuration (setIOCache, setMmap, attachSharedCache) must not be changed while
+ * contexts are reading.
+ */
+class ReadContext {
+  friend class jsFileReader;
+
+public:
+  ~ReadContext();
+
+  /**
+   * @brief Reads the frame given by its global index, see jsFileReader::readFrame
+   * @return the number of live traces in the frame, or an error code (<0)
+   */
+  int readFrame(const long _frameIndex, float *frame, char *headbuf = NULL);
+
+  /**
+   * @brief Reads the trace headers of the frame given by its global index, see jsFileReader::readFrameHeader
+   * @return the number of live traces in the frame, or an error code (<0)
+   */
+  int readFrameHeader(const long _frameIndex, char *headbuf);
+
+  /**
+   * @brief Reads the live traces among _numOfTraces traces starting from global trace index _firstTraceIndex,
+   *        see jsFileReader::readTraces. The last frame read is kept, so consecutive calls read each frame once.
+   * @return the number of live traces read, or an error code (<0)
+   */
+  long readTraces(const long _firstTraceIndex, const long _numOfTraces, float *buffer, char *headbuf = NULL);
+
+  const jsFileReader *getReader() const {
+    return m_reader;
+  }
+
+private:
+  ReadContext(jsFileReader *_reader);
+  int init();
+  int readBuffer(bool _header, long _offset, char *_buf, long _buflen);
+  int loadFrame(long _frameIndex, bool _withHeaders);
+
+private:
+  jsFileReader *m_reader { };
+
+  char *m_rawFrame { };
+  CharBuffer *m_traceBuffer { };
+  TraceCompressor *m_traceCompressor { };
+  SeisPEG *m_seispegCompressor { };
+
+  IOCachedReader *m_pCachedReaderTR { };
+  IOCachedReader *m_pCachedReaderHD { };
+  int m_currIndexOfTrFileExtent { -1 };
+  int m_currIndexOfTrHeadExtent { -1 };
+
+  //frame buffer for readTraces
+  float *m_frame { };
+  char *m_frameHeader { };
+  long m_frameInd { -1 };
+  int m_numOfFrameLiveTraces { };
+  bool m_bFrameHeaders { };
+};
+}
+
+#endif
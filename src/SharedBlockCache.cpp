@@ -0,0 +1,155 @@
+/***************************************************************************
+ SharedBlockCache.cpp
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "SharedBlockCache.h"
+#include "PSProLogging.h"
+#include "FileUtil.h"
+
+namespace jsIO {
+DECLARE_LOGGER(SharedBlockCacheLog);
+
+static std::mutex s_instanceMutex;
+static std::shared_ptr<SharedBlockCache> s_instance;
+
+SharedBlockCache::SharedBlockCache(unsigned long _budget, unsigned long _blockSize, int _numShards) :
+  m_blockSize(_blockSize), m_shards(_numShards) {
+  m_blocksPerShard = std::max(1UL, _budget / _blockSize / _numShards);
+}
+
+SharedBlockCache::~SharedBlockCache() {
+  for(size_t i = 0; i < m_shards.size(); i++) {
+    std::unordered_map<long, Block>::iterator it;
+    for(it = m_shards[i].blocks.begin(); it != m_shards[i].blocks.end(); ++it)
+      delete[] it->second.data;
+  }
+}
+
+std::shared_ptr<SharedBlockCache> SharedBlockCache::getInstance() {
+  std::lock_guard<std::mutex> lock(s_instanceMutex);
+  return s_instance;
+}
+
+int SharedBlockCache::configure(unsigned long _budget, unsigned long _blockSize, int _numShards) {
+  if(_budget > 0 && (_blockSize == 0 || _numShards <= 0)) {
+    ERROR_PRINTF(SharedBlockCacheLog, "Invalid block size %lu or number of shards %d", _blockSize, _numShards);
+    return JS_USERERROR;
+  }
+  std::shared_ptr<SharedBlockCache> cache;
+  if(_budget > 0) cache = std::make_shared<SharedBlockCache>(_budget, _blockSize, _numShards);
+  std::lock_guard<std::mutex> lock(s_instanceMutex);
+  s_instance = cache; // attached readers keep the previous cache alive
+  return JS_OK;
+}
+
+int SharedBlockCache::getFileId(const std::string &_path) {
+  std::lock_guard<std::mutex> lock(m_fileMutex);
+  std::unordered_map<std::string, int>::iterator it = m_fileIds.find(_path);
+  if(it != m_fileIds.end()) return it->second;
+  int id = m_fileIds.size();
+  m_fileIds[_path] = id;
+  return id;
+}
+
+bool SharedBlockCache::read(int _fileId, int _fd, unsigned long _fileSize, unsigned long _offset, unsigned char *_buffer,
+    unsigned long _length, JS_CACHE_STATS &_stats) {
+  while(_length > 0) {
+    unsigned long blockNo = _offset / m_blockSize;
+    unsigned long inBlock = _offset - blockNo * m_blockSize;
+    unsigned long n = std::min(_length, m_blockSize - inBlock);
+    long key = ((long)_fileId << 40) | (long)blockNo;
+    if(!readBlock(key, _fd, _fileSize, blockNo * m_blockSize, inBlock, _buffer, n, _stats)) return false;
+    _buffer += n;
+    _offset += n;
+    _length -= n;
+  }
+  return true;
+}
+
+bool SharedBlockCache::readBlock(long _key, int _fd, unsigned long _fileSize, unsigned long _blockOffset, unsigned long _inBlock,
+    unsigned char *_buffer, unsigned long _length, JS_CACHE_STATS &_stats) {
+  Shard &shard = getShard(_key);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    std::unordered_map<long, Block>::iterator it = shard.blocks.find(_key);
+    if(it != shard.blocks.end()) {
+      Block &block = it->second;
+      if(_inBlock + _length > block.length) return false;
+      memcpy(_buffer, block.data + _inBlock, _length);
+      shard.lru.splice(shard.lru.begin(), shard.lru, block.lruPos);
+      shard.stats.hits++;
+      _stats.hits++;
+      return true;
+    }
+  }
+
+  // read without holding the lock, other threads may load the same block meanwhile
+  unsigned long readSize = std::min(m_blockSize, _fileSize - _blockOffset);
+  unsigned char *data = new unsigned char[readSize];
+  unsigned long actRead = wrapIOFull(pread, _fd, data, readSize, _blockOffset);
+  if(actRead != readSize || _inBlock + _length > readSize) {
+    TRACE_PRINTF(SharedBlockCacheLog, "Can't read %lu bytes at offset %lu", readSize, _blockOffset);
+    delete[] data;
+    return false;
+  }
+  memcpy(_buffer, data + _inBlock, _length);
+  _stats.misses++;
+  _stats.bytesRead += actRead;
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.stats.misses++;
+  shard.stats.bytesRead += actRead;
+  if(shard.blocks.find(_key) != shard.blocks.end()) {
+    delete[] data;
+    return true;
+  }
+  while(shard.blocks.size() >= m_blocksPerShard) {
+    std::unordered_map<long, Block>::iterator victim = shard.blocks.find(shard.lru.back());
+    delete[] victim->second.data;
+    shard.blocks.erase(victim);
+    shard.lru.pop_back();
+    shard.stats.evictions++;
+    _stats.evictions++;
+  }
+  shard.lru.push_front(_key);
+  Block &block = shard.blocks[_key];
+  block.lruPos = shard.lru.begin();
+  block.data = data;
+  block.length = readSize;
+  return true;
+}
+
+JS_CACHE_STATS SharedBlockCache::getStats() const {
+  JS_CACHE_STATS stats = JS_CACHE_STATS();
+  for(size_t i = 0; i < m_shards.size(); i++) {
+    const Shard &shard = m_shards[i];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    stats.hits += shard.stats.hits;
+    stats.misses += shard.stats.misses;
+    stats.evictions += shard.stats.evictions;
+    stats.bytesRead += shard.stats.bytesRead;
+  }
+  return stats;
+}
+}
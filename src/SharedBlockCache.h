@@ -0,0 +1,99 @@
+/***************************************************************************
+ SharedBlockCache.h
+ -------------------
+ copyright            : (C) 2012 Fraunhofer ITWM
+
+ This file is part of jseisIO.
+
+ jseisIO is free software: you can redistribute it and/or modify
+ it under the terms of the Lesser General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ jseisIO is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ Lesser General Public License for more details.
+
+ You should have received a copy of the Lesser General Public License
+ along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+ ***************************************************************************/
+
+#ifndef SHAREDBLOCKCACHE_H
+#define SHAREDBLOCKCACHE_H
+
+#include <string>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+
+#include "jsDefs.h"
+
+namespace jsIO {
+
+/**
+ * Thread-safe block cache shared by the IOCachedReader objects of several jsFileReader instances.
+ * Blocks are keyed by (extent file, block offset) and kept in shards with an own lock and LRU list,
+ * the memory budget is split evenly between the shards.
+ * The files must not be modified while their blocks are cached.
+ */
+class SharedBlockCache {
+public:
+  SharedBlockCache(unsigned long _budget, unsigned long _blockSize, int _numShards);
+  ~SharedBlockCache();
+
+  // process-wide instance, NULL if not configured
+  static std::shared_ptr<SharedBlockCache> getInstance();
+  // replaces the process-wide instance, _budget=0 removes it
+  static int configure(unsigned long _budget, unsigned long _blockSize, int _numShards);
+
+  unsigned long getBlockSize() const {
+    return m_blockSize;
+  }
+
+  // key of the file with the given path, the same for all readers
+  int getFileId(const std::string &_path);
+
+  /*
+   * Reads _length bytes at _offset of the file _fileId (opened as _fd with size _fileSize) through the cache.
+   * The range must be located in the file. Hits and misses are added to _stats too.
+   */
+  bool read(int _fileId, int _fd, unsigned long _fileSize, unsigned long _offset, unsigned char *_buffer,
+      unsigned long _length, JS_CACHE_STATS &_stats);
+
+  JS_CACHE_STATS getStats() const;
+
+private:
+  struct Block {
+    std::list<long>::iterator lruPos;
+    unsigned char *data;
+    unsigned long length;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    std::list<long> lru; // keys, most recently used first
+    std::unordered_map<long, Block> blocks;
+    JS_CACHE_STATS stats {};
+  };
+
+  Shard &getShard(long _key) {
+    return m_shards[(((unsigned long)_key * 0x9E3779B97F4A7C15UL) >> 40) % m_shards.size()];
+  }
+
+  bool readBlock(long _key, int _fd, unsigned long _fileSize, unsigned long _blockOffset, unsigned long _inBlock,
+      unsigned char *_buffer, unsigned long _length, JS_CACHE_STATS &_stats);
+
+private:
+  unsigned long m_blockSize { };
+  unsigned long m_blocksPerShard { };
+  std::vector<Shard> m_shards;
+
+  std::mutex m_fileMutex;
+  std::unordered_map<std::string, int> m_fileIds;
+};
+}
+
+#endif
@@ -37,6 +37,7 @@ TraceMap::~TraceMap() {
     delete[] m_pTraceMapArray;
     m_pTraceMapArray = NULL;
   }
+  releaseAll();
   if(m_pAxisLengths != NULL) {
     delete[] m_pAxisLengths;
     m_pAxisLengths = NULL;
@@ -71,6 +72,7 @@ TraceMap::TraceMap(long *_axisLengths, int _numAxis, JS_BYTEORDER _byteOrder, st
 
 int TraceMap::Init(long *_axisLengths, int _numAxis, JS_BYTEORDER _byteOrder, std::string path, std::string mode) {
   m_nVolumeIndex = NOTDEFINDEX;
+  releaseAll();
   m_nReadCacheHit = 0;
   m_nReadCounter = 0;
   m_nWriteCounter = 0;
@@ -92,6 +94,9 @@ int TraceMap::Init(long *_axisLengths, int _numAxis, JS_BYTEORDER _byteOrder, st
   //the internal tracMapArray which holds one volume worth of fold info
   // m_numFrames = m_pAxisLengths[m_numAxis-1];
   m_numFrames = m_pAxisLengths[2];
+  m_totalNumFrames = 1;
+  for(int i = 2; i < m_numAxis; i++)
+    m_totalNumFrames *= m_pAxisLengths[i];
 
   //     TRACE_PRINTF(TraceMapLog, "m_numAxis=%d, m_numFrames=%ld\n", m_numAxis,m_numFrames);
 
@@ -156,6 +161,7 @@ int TraceMap::getFold(const int *position) {
 }
 /* Returns the fold for the frame with index frameIndex */
 int TraceMap::getFold(int frameIndex) {
+  if(m_pAllFoldsArray != NULL) return m_pAllFoldsArray[frameIndex];
   // This will load the fold for the entire volume
   loadVolume(frameIndex);
   int pos = frameIndex - (int)(frameIndex / m_numFrames) * m_numFrames;
@@ -177,11 +183,34 @@ int TraceMap::putFold(int *position, int numTraces) {
 }
 
 int TraceMap::putFold(long glbframeIndex, int numTraces) {
-  m_nWriteCounter++;
   // insert the fold value into the array
   long oldMapFilePosition = glbframeIndex * sizeof(int);
   int posloc = glbframeIndex - (int)(glbframeIndex / m_numFrames) * m_numFrames;
   m_pTraceMapArray[posloc] = numTraces;
+  if(m_pAllFoldsArray != NULL) m_pAllFoldsArray[glbframeIndex] = numTraces;
+
+  if(m_bDeferredWrites) {
+    // kept until flushFolds. A frame of another volume writes the pending folds first, so the owner
+    // must have synced their traces before (see isPendingOtherVolume)
+    long volIndex = glbframeIndex / m_numFrames;
+    if(volIndex != m_nPendingVolIndex) {
+      int ires = flushFolds();
+      if(ires != JS_OK) return ires;
+      if(m_pendingFolds.empty()) {
+        m_pendingFolds.resize(m_numFrames);
+        m_pendingSet.resize(m_numFrames);
+      }
+      m_nPendingVolIndex = volIndex;
+      m_nPendingFirst = m_nPendingEnd = posloc;
+    }
+    m_pendingFolds[posloc] = numTraces;
+    m_pendingSet[posloc] = 1;
+    m_nPendingFirst = std::min(m_nPendingFirst, (long)posloc);
+    m_nPendingEnd = std::max(m_nPendingEnd, (long)posloc + 1);
+    return JS_OK;
+  }
+
+  m_nWriteCounter++;
   //    m_mapIO.seekp(oldMapFilePosition);
   //    long newMapFilePosition = m_mapIO.tellp();
   //    if (newMapFilePosition != oldMapFilePosition) {
@@ -199,6 +228,46 @@ int TraceMap::putFold(long glbframeIndex, int numTraces) {
   return JS_OK;
 }
 
+/*
+ * Enables or disables deferred writes. With deferred writes putFold only keeps the folds of one volume
+ * in memory. They are written (contiguous frames with one write) and synced by flushFolds, by closefp
+ * and when putFold gets a frame of another volume. Only frames set by putFold are written, so that
+ * writers of other frames aren't affected.
+ */
+void TraceMap::setDeferredWrites(bool _deferred) {
+  if(!_deferred) flushFolds();
+  m_bDeferredWrites = _deferred;
+}
+
+/* Writes the folds kept by putFold in deferred mode to disk */
+int TraceMap::flushFolds() {
+  if(m_nPendingVolIndex < 0) return JS_OK;
+  int ires = JS_OK;
+  long firstVolFrame = m_nPendingVolIndex * m_numFrames;
+  long i = m_nPendingFirst;
+  while(i < m_nPendingEnd) {
+    if(!m_pendingSet[i]) {
+      i++;
+      continue;
+    }
+    long first = i;
+    for(; i < m_nPendingEnd && m_pendingSet[i]; i++)
+      m_pendingSet[i] = 0;
+    long n = i - first;
+
+    m_nWriteCounter++;
+    if(m_bSwapByteOrder) endian_swap((void*)&m_pendingFolds[first], n, sizeof(int));
+    long nbytes = n * sizeof(int);
+    if(wrapIOFull(pwrite, m_mapfd, (void*)&m_pendingFolds[first], nbytes, (firstVolFrame + first) * sizeof(int)) != nbytes) {
+      ERROR_PRINTF(TraceMapLog, "Unable to write the fold of frames [%ld,%ld)", firstVolFrame + first, firstVolFrame + i);
+      ires = JS_USERERROR;
+    }
+  }
+  if(::fsync(m_mapfd) != 0) ires = JS_USERERROR;
+  m_nPendingVolIndex = -1;
+  return ires;
+}
+
 /**
  * Sets the fold for an entire volume.  This does not attempt to merge
  * the fold values for frames within this volume.  The typical use for
@@ -343,6 +412,38 @@ int TraceMap::loadVolume(int frameIndex) {
   return JS_OK;
 }
 
+/*
+ * Reads the fold of all frames with one read and keeps it in memory until releaseAll,
+ * getFold doesn't access the file then.
+ */
+int TraceMap::loadAll() {
+  if(m_pAllFoldsArray != NULL) return JS_OK;
+  int *folds = new int[m_totalNumFrames];
+  long nbytes = m_totalNumFrames * sizeof(int);
+  if(wrapIOFull(pread, m_mapfd, (void*)folds, nbytes, 0) != nbytes) {
+    ERROR_PRINTF(TraceMapLog, "Unable to read %ld bytes from TraceMap", nbytes);
+    delete[] folds;
+    return JS_USERERROR;
+  }
+  if(m_bSwapByteOrder) endian_swap((void*)folds, m_totalNumFrames, sizeof(int));
+  m_pAllFoldsArray = folds;
+  m_nReadCounter++;
+  return JS_OK;
+}
+
+/* Releases the folds loaded with loadAll, getFold loads a volume at a time again. */
+void TraceMap::releaseAll() {
+  if(m_pAllFoldsArray != NULL) {
+    delete[] m_pAllFoldsArray;
+    m_pAllFoldsArray = NULL;
+  }
+}
+
+/** Return the fold of all frames, NULL if not loaded with loadAll */
+const int* TraceMap::getAllFoldsArray() const {
+  return (const int*)m_pAllFoldsArray;
+}
+
 long TraceMap::getVolumeOffset(int *position) const {
   long frameIndex = getFrameIndex(position);
   int volIndex = (int)(frameIndex / m_numFrames);
@@ -385,6 +486,7 @@ void TraceMap::closefp() {
   //    TRACE_PRINTF(TraceMapLog, "TraceMap reads = %li, read cached hits %li, TraceMap writes = %li",m_nReadCounter,m_nReadCacheHit,m_nWriteCounter) ;
   //   m_mapIO.close();
   if(m_mapfd >= 0) {
+    flushFolds();
     ::fsync(m_mapfd);
     ::close(m_mapfd);
   }
@@ -57,6 +57,12 @@ public:
   int Init(long *_axisLengths, int _numAxis, JS_BYTEORDER _byteOrder, std::string path, std::string mode);
 
   int loadVolume(int frameIndex);
+  int loadAll();
+  void releaseAll();
+  bool isLoadedAll() const {
+    return m_pAllFoldsArray != NULL;
+  }
+  const int* getAllFoldsArray() const;
   void emptyCache();
   int getFold(const int *position);
   int getFold(int frameIndex);
@@ -64,6 +70,16 @@ public:
   int putFold(int *position, int numTraces);
   int putFold(long glbframeIndex, int numTraces);
 
+  void setDeferredWrites(bool _deferred);
+  bool isDeferredWrites() const {
+    return m_bDeferredWrites;
+  }
+  ///@return true if folds of another volume than the one of glbframeIndex are pending
+  bool isPendingOtherVolume(long glbframeIndex) const {
+    return m_nPendingVolIndex >= 0 && glbframeIndex / m_numFrames != m_nPendingVolIndex;
+  }
+  int flushFolds();
+
   void intializeTraceMapOnDisk();
   const int* getTraceMapArray() const;
   void closefp();
@@ -90,6 +106,16 @@ private:
   static const int NOTDEFINDEX = -100;
   int *m_pTraceMapArray;
 
+  long m_totalNumFrames { };
+  int *m_pAllFoldsArray { }; //fold of all frames, if loaded with loadAll
+
+  bool m_bDeferredWrites { };
+  long m_nPendingVolIndex { -1 }; //volume of the folds not yet written by flushFolds, -1 if none
+  std::vector<int> m_pendingFolds; //fold of the frames of that volume
+  std::vector<char> m_pendingSet; //1 for the frames set by putFold
+  long m_nPendingFirst { }; //frames [m_nPendingFirst,m_nPendingEnd) of the volume contain all pending folds
+  long m_nPendingEnd { };
+
 private:
   void initTraceMapArray();
   void checkVolumeIndex() const;
@@ -22,6 +22,7 @@
  ***************************************************************************/
 
 #include "BlockCompressor.h"
+#include "SimdDefs.h"
 #include "../PSProLogging.h"
 
 namespace jsIO {
@@ -32,6 +33,103 @@ union int_float_bits {
   float float_bits;
 };
 
+/*
+ * Vectorized kernels of computeDelta, quantize and dequantize.
+ * The sums of squares use eight double partial sums on every CPU, so delta does not depend on the
+ * selected instruction set (it may differ in the last bits from the sequential sum of the scalar code).
+ * Quantized and dequantized values are bit-identical to the scalar code.
+ */
+#ifdef JS_HAVE_CONVERTVECTOR
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+
+// sum of x[i]*x[i]
+JS_TARGET_CLONES
+static double sumSquaresBlocks(const float *x, int n) {
+  v8df acc = { };
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    v8sf v;
+    memcpy(&v, &x[i], sizeof(v8sf));
+    acc += __builtin_convertvector(v * v, v8df);
+  }
+  double sum = 0.0;
+  for(int k = 0; k < 8; k++) sum += acc[k];
+  for(; i < n; i++) sum += (double)(x[i] * x[i]);
+  return sum;
+}
+
+// sum of x[i]*x[i] over the samples with x[i] > threshold or x[i] < -threshold, their number in count
+JS_TARGET_CLONES
+static double sumSquaresAboveBlocks(const float *x, int n, float threshold, int *count) {
+  v8df acc = { };
+  v8si cnt = { };
+  v8sf thr = threshold + (v8sf) { };
+  v8sf mthr = -thr;
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    v8sf v;
+    memcpy(&v, &x[i], sizeof(v8sf));
+    v8si mask = (v > thr) | (v < mthr);
+    v8sf sq = (v8sf)((v8si)(v * v) & mask);
+    acc += __builtin_convertvector(sq, v8df);
+    cnt -= mask;
+  }
+  double sum = 0.0;
+  int n2 = 0;
+  for(int k = 0; k < 8; k++) {
+    sum += acc[k];
+    n2 += cnt[k];
+  }
+  for(; i < n; i++) {
+    if(x[i] > threshold || x[i] < -threshold) {
+      n2++;
+      sum += (double)(x[i] * x[i]);
+    }
+  }
+  *count = n2;
+  return sum;
+}
+
+// ix[i] = x[i]*rdelta rounded half away from zero
+JS_TARGET_CLONES
+static void quantizeBlocks(const float *x, int n, float rdelta, int *ix) {
+  const v8si half = (v8si)(0.5F + (v8sf) { });
+  const v8si signBit = (v8si) { } + (int)0x80000000;
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    v8sf v;
+    memcpy(&v, &x[i], sizeof(v8sf));
+    v8sf t = v * rdelta;
+    // +-0.5 with the sign of t; +0.5 for t == +0 truncates to 0 as well
+    t += (v8sf)(half | ((v8si)t & signBit));
+    v8si q = __builtin_convertvector(t, v8si);
+    memcpy(&ix[i], &q, sizeof(v8si));
+  }
+  for(; i < n; i++) {
+    float temp = x[i] * rdelta;
+    ix[i] = (temp > 0.0) ? (int)(temp + 0.5F) : (int)(temp - 0.5F);
+  }
+}
+
+// x[i] = ix[i]*delta, exact zeros stay +0
+JS_TARGET_CLONES
+static void dequantizeBlocks(const int *ix, int n, float delta, float *x) {
+  const v8si zero = { };
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    v8si q;
+    memcpy(&q, &ix[i], sizeof(v8si));
+    v8sf v = __builtin_convertvector(q, v8sf) * delta;
+    v = (v8sf)((v8si)v & (q != zero));
+    memcpy(&x[i], &v, sizeof(v8sf));
+  }
+  for(; i < n; i++) x[i] = (ix[i] == 0) ? 0.0F : (float)ix[i] * delta;
+}
+
+#pragma GCC pop_options
+#endif
+
 BlockCompressor::~BlockCompressor() {
   delete []idata;
   delete []huffchars;
@@ -150,7 +248,7 @@ int BlockCompressor::unsignedShort(short i) {
  * @param  distortion  desired distortion level.
  * @return  quantization delta.
  */
-float BlockCompressor::computeDelta(float *x, int n, float distortion) {
+float BlockCompressor::computeDelta(const float *x, int n, float distortion) {
   if(Transformer::c_integrityTest) {
     return 1.0F;
   }
@@ -158,8 +256,15 @@ float BlockCompressor::computeDelta(float *x, int n, float distortion) {
   float delta, quarterDelta, mquarterDelta;
   int i, n2;
   /* Get a low approximation of delta. */
-  blockVar = 0.0;
-  for(i = 0; i < n; i++) blockVar += (double)(x[i] * x[i]);
+#ifdef JS_HAVE_CONVERTVECTOR
+  if(Transformer::c_vectorized) {
+    blockVar = sumSquaresBlocks(x, n);
+  } else
+#endif
+  {
+    blockVar = 0.0;
+    for(i = 0; i < n; i++) blockVar += (double)(x[i] * x[i]);
+  }
 
   blockVar /= (double)n;
   blockVar = sqrt(blockVar);
@@ -169,18 +274,25 @@ float BlockCompressor::computeDelta(float *x, int n, float distortion) {
   /* Compute delta without the near-zero samples. */
   quarterDelta = delta * 0.25F;
   mquarterDelta = -quarterDelta;
-  blockVar = 0.0;
-  n2 = 0;
-  /* Every 8th sample should be OK for this application. */
-  /* Why not use them all - should make very little difference. */
-  /* for ( i=0; i<n; i+=8 ) { */
-  for(i = 0; i < n; i++) {
-    if(x[i] > quarterDelta) {
-      n2++;
-      blockVar += (double)(x[i] * x[i]);
-    } else if(x[i] < mquarterDelta) {
-      n2++;
-      blockVar += (double)(x[i] * x[i]);
+#ifdef JS_HAVE_CONVERTVECTOR
+  if(Transformer::c_vectorized) {
+    blockVar = sumSquaresAboveBlocks(x, n, quarterDelta, &n2);
+  } else
+#endif
+  {
+    blockVar = 0.0;
+    n2 = 0;
+    /* Every 8th sample should be OK for this application. */
+    /* Why not use them all - should make very little difference. */
+    /* for ( i=0; i<n; i+=8 ) { */
+    for(i = 0; i < n; i++) {
+      if(x[i] > quarterDelta) {
+        n2++;
+        blockVar += (double)(x[i] * x[i]);
+      } else if(x[i] < mquarterDelta) {
+        n2++;
+        blockVar += (double)(x[i] * x[i]);
+      }
     }
   }
 
@@ -204,10 +316,16 @@ float BlockCompressor::computeDelta(float *x, int n, float distortion) {
  * @param  quantization delta.
  * @param  output quantized samples.
  */
-void BlockCompressor::quantize(float *x, int n, float delta, int *ix) {
+void BlockCompressor::quantize(const float *x, int n, float delta, int *ix) {
   int i;
   float temp;
   delta = 1.0F / delta;
+#ifdef JS_HAVE_CONVERTVECTOR
+  if(Transformer::c_vectorized) {
+    quantizeBlocks(x, n, delta, ix);
+    return;
+  }
+#endif
   for(i = 0; i < n; i++) {
     temp = x[i] * delta;
     // Math.round() is dreadfully slow.
@@ -345,15 +463,15 @@ void BlockCompressor::setDelta(float delta) {
 
 
 /*
- * Run-length decoding and dequantization (both steps applied at once for
- * performance gain.  NOTE: the output must not overlay the input.
+ * Run-length decoding. The output is dequantized by dequantize() in a second pass,
+ * which can be vectorized.  NOTE: the output must not overlay the input.
  *
  * @param  huffchars  Huffman decoded data (needs run-length decoding).
  * @param  nbytes  number of input bytes.
- * @param  delta  quantization delta.
- * @param  quantdata  output decoded and dequantized data.
+ * @param  quantdata  output decoded quantized data.
+ * @return  number of decoded values.
  */
-void BlockCompressor::runLengthDecodeDequant(char *_huffchars, int nbytes, float delta, float *quantdata) {
+int BlockCompressor::runLengthDecode(const char *_huffchars, int nbytes, int *quantdata) {
   int i, j, iend, ival;
   //     short si;
   for(i = j = 0; i < nbytes;) {
@@ -364,7 +482,7 @@ void BlockCompressor::runLengthDecodeDequant(char *_huffchars, int nbytes, float
 
     if(ihuffchar > 0  &&  ihuffchar < 101) {
       iend = j + ihuffchar;
-      for(; j < iend; j++) quantdata[j] = 0.0F;
+      for(; j < iend; j++) quantdata[j] = 0;
       i++;
     } else if(ihuffchar == 105) {
       i++;
@@ -372,11 +490,11 @@ void BlockCompressor::runLengthDecodeDequant(char *_huffchars, int nbytes, float
       ival = (int)_huffchars[i];
       if(ival < 0) ival += 256;
       iend = j + ival;
-      for(; j < iend; j++) quantdata[j] = 0.0F;
+      for(; j < iend; j++) quantdata[j] = 0;
       i++;
     } else if(ihuffchar > 106  &&  ihuffchar < 255) {
-      // quantdata[j++] = ((float)unsignedByte(huffchars[i++]) - 180.0F) * delta;
-      quantdata[j++] = ((float)ihuffchar - 180.0F) * delta;
+      // quantdata[j++] = unsignedByte(huffchars[i++]) - 180;
+      quantdata[j++] = ihuffchar - 180;
       i++;
     } else {
       if(_huffchars[i] == 101) {
@@ -384,28 +502,28 @@ void BlockCompressor::runLengthDecodeDequant(char *_huffchars, int nbytes, float
         // ival = unsignedByte(huffchars[i]);
         ival = (int)_huffchars[i];
         if(ival < 0) ival += 256;
-        quantdata[j++] = (float)ival * delta;
+        quantdata[j++] = ival;
         i++;
       } else if(_huffchars[i] == 102) {
         i++;
         // ival = unsignedByte(huffchars[i]);
         ival = (int)_huffchars[i];
         if(ival < 0) ival += 256;
-        quantdata[j++] = (-(float)ival) * delta;
+        quantdata[j++] = -ival;
         i++;
       } else if(_huffchars[i] == 103) {
         i++;
         // ival = unsignedShort(stuffBytesInShort(huffchars, i));
         ival = stuffBytesInShort(_huffchars, i);
         if(ival < 0) ival += 65536;
-        quantdata[j++] = (float)ival * delta;
+        quantdata[j++] = ival;
         i += 2;
       } else if(_huffchars[i] == 104) {
         i++;
         // ival = unsignedShort(stuffBytesInShort(huffchars, i));
         ival = stuffBytesInShort(_huffchars, i);
         if(ival < 0) ival += 65536;
-        quantdata[j++] = (-(float)ival) * delta;
+        quantdata[j++] = -ival;
         i += 2;
       } else if(_huffchars[i] == 106) {
         i++;
@@ -413,23 +531,45 @@ void BlockCompressor::runLengthDecodeDequant(char *_huffchars, int nbytes, float
         ival = stuffBytesInShort(_huffchars, i);
         if(ival < 0) ival += 65536;
         iend = j + ival;
-        for(; j < iend; j++) quantdata[j] = 0.0F;
+        for(; j < iend; j++) quantdata[j] = 0;
         i += 2;
       } else if(ihuffchar == 255) {
         i++;
         ival = stuffBytesInInt(_huffchars, i);
-        quantdata[j++] = ((float)ival) * delta;
+        quantdata[j++] = ival;
         i += 4;
       } else {
         TRACE_PRINTF(BlockCompressorLog, "Warning: HuffTableDecode: bad character encountered at element %d", (int)_huffchars[i]);
         // Just punt - don't know what else to do.  This may actually happen,
         // because data gets corrupted.
         // TODO: Perhaps we should zero the data.
-        return;
+        return j;
       }
     }
   }
-  return;
+  return j;
+}
+
+
+/*
+ * Dequantization.
+ *
+ * @param  ix  quantized samples.
+ * @param  n  number of samples.
+ * @param  delta  quantization delta.
+ * @param  x  output dequantized samples.
+ */
+void BlockCompressor::dequantize(const int *ix, int n, float delta, float *x) {
+#ifdef JS_HAVE_CONVERTVECTOR
+  if(Transformer::c_vectorized) {
+    dequantizeBlocks(ix, n, delta, x);
+    return;
+  }
+#endif
+  for(int i = 0; i < n; i++) {
+    if(ix[i] == 0) x[i] = 0.0F;
+    else x[i] = (float)ix[i] * delta;
+  }
 }
 
 
@@ -534,9 +674,10 @@ int BlockCompressor::dataEncode(float *data, int nsamps, float distortion, char
  * @param  workBufferSize  size of the work buffer.
  * @param  nsamps  number of output samples.
  * @param  data  output decoded data.
+ * @param  encodedSize  number of encoded bytes starting at index, -1 if unknown (slower).
  */
 int BlockCompressor::dataDecode(const char *encodedData, int index, char *workBuffer,
-                                int workBufferSize, int nsamps, float *data) {
+                                int workBufferSize, int nsamps, float *data, int encodedSize) {
 
   /* Unload delta. */
   float delta;
@@ -551,12 +692,19 @@ int BlockCompressor::dataDecode(const char *encodedData, int index, char *workBu
   index += SIZEOF_INT;
 
   /* Huffman decode. */
-  int nbytes = huffCoder.huffDecode(encodedData, index, workBuffer, workBufferSize);
+  int nbytes = huffCoder.huffDecode(encodedData, index, workBuffer, workBufferSize,
+                                    (encodedSize < 0) ? -1 : encodedSize - SIZEOF_FLOAT - SIZEOF_INT);
 
   if(nbytes == -1) return JS_WARNING;
 
   /* Run-length decode and dequantize. */
-  runLengthDecodeDequant(workBuffer, nbytes, delta, data);
+  if(idata_len < nsamps + 2) {
+    delete[]idata;
+    idata_len = nsamps + 2;
+    idata = new int[idata_len];
+  }
+  int ndecoded = runLengthDecode(workBuffer, nbytes, idata);
+  dequantize(idata, ndecoded, delta, data);
 
   /* Fill in the zeros. */
   /* We know that nNonZero is a multiple of 2. */
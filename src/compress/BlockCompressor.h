@@ -49,7 +49,8 @@ public:
   void setDelta(float delta);
 
   int dataEncode(float *data, int nsamps, float distortion, char *encodedData, int index, int outputBufferSize);
-  int dataDecode(const char *encodedData, int index, char *workBuffer, int workBufferSize, int nsamps, float *data);
+  int dataDecode(const char *encodedData, int index, char *workBuffer, int workBufferSize, int nsamps, float *data,
+                 int encodedSize = -1);
 
   static void stuffIntInBytes(int ival, char *bvals, int offset);
   static int stuffBytesInInt(const char *bvals, int index);
@@ -61,7 +62,10 @@ public:
   static float intBitsToFloat(int x);
 
 public:
-
+  // Quantization kernels, vectorized if Transformer::c_vectorized is set.
+  static float computeDelta(const float *x, int n, float distortion);
+  static void quantize(const float *x, int n, float delta, int *ix);
+  static void dequantize(const int *ix, int n, float delta, float *x);
 
 
   // private atributes
@@ -70,9 +74,7 @@ private:
   static int nint(double a) {return (a > 0.0) ? (int)(a + 0.5F) : (int)(a - 0.5F);} // Faster than Math.round().
   static int unsignedByte(char i);
   static int unsignedShort(short i);
-  static float computeDelta(float *x, int n, float distortion);
-  static void quantize(float *x, int n, float delta, int *ix);
-  static void runLengthDecodeDequant(char *huffchars, int nbytes, float delta, float *quantdata);
+  static int runLengthDecode(const char *huffchars, int nbytes, int *quantdata);
 private:
   bool c_littleEndian;
   static const int SIZEOF_INT = 4;
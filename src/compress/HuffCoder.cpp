@@ -24,6 +24,10 @@
 
 
 #include "HuffCoder.h"
+#include <algorithm>
+#include <stdint.h>
+#include <map>
+#include <mutex>
 
 namespace jsIO {
 /* This is the value count that is used to use to precompute Huffman tables. */
@@ -147,14 +151,12 @@ const int HuffCoder::c_hdrHuffCountImproved[257] = {
 };
 
 HuffCoder::~HuffCoder() {
-  deleteTree(globalRoot);
   delete[]huffCode;
   delete[]huffLen;
   delete[]bVals;
 }
 
 HuffCoder::HuffCoder() {
-  globalRoot = NULL;
   huffCode = new int[MAXVALUEP1];
   huffLen = new int[MAXVALUEP1];
   bVals = new char[4];
@@ -162,7 +164,6 @@ HuffCoder::HuffCoder() {
 
 
 HuffCoder::HuffCoder(const int *huffTable) {
-  globalRoot = NULL;
   huffCode = new int[MAXVALUEP1];
   huffLen = new int[MAXVALUEP1];
   bVals = new char[4];
@@ -176,7 +177,7 @@ void HuffCoder::Init(const int *huffTable) {
   int *heap = new int[MAXVALUEP1 + 1];
   int *parent = new int[2 * MAXVALUEP1];
   huffTableMake(count, heap, parent, huffCode, huffLen);
-  globalRoot = buildHuffmanTree();
+  decodeTable = getDecodeTable(huffTable);
   delete[]count;
   delete[]heap;
   delete[]parent;
@@ -292,73 +293,98 @@ void HuffCoder::downHeap(int *count, int *heap, int N, int k) {
 }
 
 
-/**
- * Builds the Huffman tree.  This method is only called during the constructor.
- *
- * @return  the root Huffman node.
+/*
+ * Returns the decoding table for the Huffman codes in huffCode/huffLen, which were made from huffTable.
+ * The tables are built once per distinct value count and shared by all coders.
  */
-HuffNode *HuffCoder::buildHuffmanTree() {
-  int i;
-  HuffNode *root;
+std::shared_ptr<const std::vector<HuffCoder::DecodeEntry> > HuffCoder::getDecodeTable(const int *huffTable) {
+  static std::mutex tablesMutex;
+  static std::map<std::vector<int>, std::shared_ptr<const std::vector<DecodeEntry> > > tables;
+
+  std::vector<int> key(huffTable, huffTable + MAXVALUEP1);
+  std::lock_guard<std::mutex> lock(tablesMutex);
+  auto it = tables.find(key);
+  if(it != tables.end()) return it->second;
+
+  /* The codes are read starting with their highest bit, the table index starts with the lowest bit. */
+  int reversedCode[MAXVALUEP1];
+  std::vector<int> syms;
+  for(int v = 0; v <= MAXVALUE; v++) {
+    reversedCode[v] = 0;
+    for(int b = 0; b < huffLen[v]; b++) reversedCode[v] |= ((huffCode[v] >> (huffLen[v] - 1 - b)) & 1) << b;
+    if(huffLen[v] != 0) syms.push_back(v);
+  }
 
-  root = new HuffNode();
-  //     root->left = root->right = NULL;
-  //     root->info = -1;
-  for(i = 0; i <= MAXVALUE; i++) {
-    if(huffLen[i] != 0) addTree(root, huffCode[i], huffLen[i], i);
+  std::shared_ptr<std::vector<DecodeEntry> > table = std::make_shared<std::vector<DecodeEntry> >();
+  buildDecodeTable(*table, syms, reversedCode, huffLen, 0, PRIMARYBITS);
+
+  /* Append the symbols which follow in the same primary index. */
+  std::vector<DecodeEntry> single(table->begin(), table->begin() + (1 << PRIMARYBITS));
+  for(int idx = 0; idx < (1 << PRIMARYBITS); idx++) {
+    DecodeEntry &e = (*table)[idx];
+    if(e.nsyms != 1) continue;
+    while(e.nsyms < MAXSYMS) {
+      const DecodeEntry &f = single[idx >> e.len];
+      if(f.nsyms != 1 || e.len + f.len1 > PRIMARYBITS) break;
+      e.syms[e.nsyms++] = f.syms[0];
+      e.len += f.len1;
+    }
   }
 
-  return root;
+  tables[key] = table;
+  return table;
 }
 
 
-/**
- * Adds a node to the Huffman tree.  This method is only called during the constructor.
+/*
+ * Fills a decoding table with 2^bits entries (and its subtables) for the given symbols.
  *
- * @param  x  input node.
- * @param  v  the value to add (?).
- * @param  l  the length to add (?).
- * @param  info  the info value (?).
- * @return  a Huffman node.
+ * @param  table  the decoding table, the new entries are appended.
+ * @param  syms  the symbols whose codes start with the index bits of the parent tables.
+ * @param  reversedCode  the bit-reversed Huffman codes.
+ * @param  codeLen  the Huffman code lengths.
+ * @param  shift  number of code bits resolved by the parent tables.
+ * @param  bits  number of index bits.
+ * @return  offset of the new table.
  */
-HuffNode *HuffCoder::addTree(HuffNode *x, int v, int l, int info) {
-  int i;
-  for(;;) {
-    if(x == NULL) {
-      x = new HuffNode();
-      //         x->left = x->right = NULL;
-      //         x->info = -1;
-    }
-    /* Get the bits. */
-    i = (v >> (l - 1)) & ~(~0u << 1);
-    if(i == 0) {    /* found a potential left branch */
-      if(x->left == NULL) {    /* we need to create it */
-        x->left = new HuffNode(); /* allocate space for it */
-        //           x->left->left = x->left->right = NULL; /* and initialize it with NULL values */
-        //           x->left->info = -1;
-      }
-      x = x->left; /* move into the left branch */
-    } else {       /* found a potential right branch */
-      if(x->right == NULL) {    /* we need to create it */
-        x->right = new HuffNode();
-        //           x->right->left = x->right->right = NULL;
-        //           x->right->info = -1;
-      }
-      x = x->right; /* move into the right branch */
+int HuffCoder::buildDecodeTable(std::vector<DecodeEntry> &table, const std::vector<int> &syms, const int *reversedCode,
+                                const int *codeLen, int shift, int bits) {
+  int offset = table.size();
+  int size = 1 << bits;
+  DecodeEntry invalid = { };
+  invalid.nsyms = INVALID;
+  invalid.len1 = invalid.len = bits;
+  table.resize(offset + size, invalid);
+
+  std::vector<std::vector<int> > longer(size);
+  for(size_t i = 0; i < syms.size(); i++) {
+    int v = syms[i];
+    int rest = codeLen[v] - shift;
+    int prefix = (reversedCode[v] >> shift) & (size - 1);
+    if(rest <= bits) {
+      DecodeEntry e = { };
+      e.nsyms = (v == MAXVALUE) ? TERMINATOR : 1;
+      e.len1 = e.len = rest;
+      e.syms[0] = (unsigned char)v;
+      for(int idx = prefix; idx < size; idx += 1 << rest) table[offset + idx] = e;
+    } else {
+      longer[prefix].push_back(v);
     }
-    l--;
-    if(l == 0) break;
   }
-  /* terminating node, so set it's info value (to something other than -1) */
-  x->info = info;
-  return x;
-}
-
 
-void HuffCoder::deleteTree(HuffNode *rootNode) {
-  if(rootNode->left != NULL)  deleteTree(rootNode->left);
-  if(rootNode->right != NULL) deleteTree(rootNode->right);
-  if(rootNode != NULL) delete rootNode;
+  for(int prefix = 0; prefix < size; prefix++) {
+    if(longer[prefix].empty()) continue;
+    int maxLen = 0;
+    for(size_t i = 0; i < longer[prefix].size(); i++) maxLen = std::max(maxLen, codeLen[longer[prefix][i]]);
+    int subBits = std::min(maxLen - shift - bits, (int)SUBBITS);
+    int subtable = buildDecodeTable(table, longer[prefix], reversedCode, codeLen, shift + bits, subBits);
+    DecodeEntry &e = table[offset + prefix];
+    e.nsyms = SUBTABLE;
+    e.len1 = bits;
+    e.len = subBits;
+    e.subtable = subtable;
+  }
+  return offset;
 }
 
 
@@ -497,120 +523,76 @@ int HuffCoder::huffEncode(int *runLengthEncodedData, int ninputInts,
 
 
 /**
- * Removes Huffman coding, using pre-computed tree.
+ * Removes Huffman coding, using pre-computed tables.
  *
  * @param  huffEncodedData  input Huffman encoded byte data.
  * @param  index  starting index in the Huffman encoded data.
  * @param  cHout  output byte data (in need of run-length decoding).
  * @param  outputBufferSize  the size of the output buffer.
+ * @param  ninputBytes  number of input bytes that may be read, -1 if unknown. If unknown,
+ *                      the input is read byte by byte and nothing after the end of the message is read.
  * @return  the number of output bytes, or -1 if the output buffer is too small.
  */
 int HuffCoder::huffDecode(const char *huffEncodedData, int index, char *cHout,
-                          int outputBufferSize) {
-  HuffNode *z;
-  int nbytes, nbytesRead = 0, k, curChar;
+                          int outputBufferSize, int ninputBytes) {
+  const DecodeEntry *table = decodeTable->data();
+  const unsigned char *in = reinterpret_cast<const unsigned char *>(&huffEncodedData[index]);
+  const unsigned char *end = (ninputBytes < 0) ? in : in + ninputBytes;
+  uint64_t bitBuf = 0;
+  int nbits = 0;
+  int k = 0;
 
   /* decode the message */
-  z = globalRoot;
-  k = 0;
   for(;;) {
-    // curChar = unsignedByte(huffEncodedData[index+nbytesRead]);
-    curChar = (int)huffEncodedData[index + nbytesRead];
-    if(curChar < 0) curChar += 256;
-    nbytesRead++;
-
-    /* Unroll the loop. */
-    if((curChar & 1) != 0) {
-      z = z->right;
-    } else {
-      z = z->left;
-    }
-    if(z->info > -1) {
-      if(z->info == MAXVALUE) break;
-      cHout[k++] = (char)z->info;
-      if(k >= outputBufferSize) return -1;
-      z = globalRoot;
-    }
-    if((curChar & 2) != 0) {
-      z = z->right;
-    } else {
-      z = z->left;
-    }
-    if(z->info > -1) {
-      if(z->info == MAXVALUE) break;
-      cHout[k++] = (char)z->info;
-      if(k >= outputBufferSize) return -1;
-      z = globalRoot;
-    }
-    if((curChar & 4) != 0) {
-      z = z->right;
-    } else {
-      z = z->left;
-    }
-    if(z->info > -1) {
-      if(z->info == MAXVALUE) break;
-      cHout[k++] = (char)z->info;
-      if(k >= outputBufferSize) return -1;
-      z = globalRoot;
-    }
-    if((curChar & 8) != 0) {
-      z = z->right;
-    } else {
-      z = z->left;
-    }
-    if(z->info > -1) {
-      if(z->info == MAXVALUE) break;
-      cHout[k++] = (char)z->info;
-      if(k >= outputBufferSize) return -1;
-      z = globalRoot;
-    }
-    if((curChar & 16) != 0) {
-      z = z->right;
-    } else {
-      z = z->left;
-    }
-    if(z->info > -1) {
-      if(z->info == MAXVALUE) break;
-      cHout[k++] = (char)z->info;
-      if(k >= outputBufferSize) return -1;
-      z = globalRoot;
-    }
-    if((curChar & 32) != 0) {
-      z = z->right;
-    } else {
-      z = z->left;
-    }
-    if(z->info > -1) {
-      if(z->info == MAXVALUE) break;
-      cHout[k++] = (char)z->info;
-      if(k >= outputBufferSize) return -1;
-      z = globalRoot;
-    }
-    if((curChar & 64) != 0) {
-      z = z->right;
-    } else {
-      z = z->left;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if(end - in >= 8) {
+      uint64_t word;
+      memcpy(&word, in, 8);
+      bitBuf |= word << nbits;
+      in += (63 - nbits) >> 3;
+      nbits |= 56;
+    } else
+#endif
+      while(nbits <= 56 && in < end) {
+        bitBuf |= (uint64_t)(*in++) << nbits;
+        nbits += 8;
+      }
+
+    const DecodeEntry *e = &table[bitBuf & ((1 << PRIMARYBITS) - 1)];
+    if(e->nsyms != TERMINATOR && e->nsyms <= MAXSYMS && e->len <= nbits && k + MAXSYMS < outputBufferSize) {
+      /* Fast path: all symbols of the entry are complete and fit into the output. */
+      memcpy(&cHout[k], e->syms, MAXSYMS);
+      k += e->nsyms;
+      bitBuf >>= e->len;
+      nbits -= e->len;
+      continue;
     }
-    if(z->info > -1) {
-      if(z->info == MAXVALUE) break;
-      cHout[k++] = (char)z->info;
-      if(k >= outputBufferSize) return -1;
-      z = globalRoot;
+
+    int shift = 0;
+    while(e->nsyms == SUBTABLE && shift + e->len1 <= nbits) {
+      shift += e->len1;
+      e = &table[e->subtable + ((bitBuf >> shift) & ((1 << e->len) - 1))];
     }
-    if((curChar & 128) != 0) {
-      z = z->right;
-    } else {
-      z = z->left;
+    if(e->nsyms == SUBTABLE || shift + e->len1 > nbits) {
+      /* The next code is not complete yet. Truncated input ends the message. */
+      if(ninputBytes >= 0 && in >= end) break;
+      bitBuf |= (uint64_t)(*in++) << nbits;
+      nbits += 8;
+      continue;
     }
-    if(z->info > -1) {
-      if(z->info == MAXVALUE) break;
-      cHout[k++] = (char)z->info;
+    /* INVALID is only possible for a degenerate table, stop as at the end of the message. */
+    if(e->nsyms == TERMINATOR || e->nsyms == INVALID) break;
+
+    int nsyms = (shift + e->len <= nbits) ? e->nsyms : 1;
+    int len = (nsyms == 1) ? e->len1 : e->len;
+    for(int i = 0; i < nsyms; i++) {
+      cHout[k++] = (char)e->syms[i];
       if(k >= outputBufferSize) return -1;
-      z = globalRoot;
     }
+    bitBuf >>= shift + len;
+    nbits -= shift + len;
   }
-  nbytes = k;
-  return nbytes;
+  return k;
 }
 
 }
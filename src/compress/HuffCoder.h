@@ -31,22 +31,10 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
+#include <memory>
 
 namespace jsIO {
-class HuffNode {
-public:
-  int info;
-  HuffNode *left;
-  HuffNode *right;
-public:
-  //    ~HuffNode();
-  HuffNode() {
-    left = NULL;
-    right = NULL;
-    info = -1;
-  };
-};
-
 class  HuffCoder {
 public:
   ~HuffCoder();
@@ -56,7 +44,7 @@ public:
 
   int huffEncode(char *runLengthEncodedData, int ninputBytes, char *huffEncodedData, int index, int outputBufferSize);
   int huffEncode(int *runLengthEncodedData, int ninputInts, char *huffEncodedData, int index, int outputBufferSize);
-  int huffDecode(const char *huffEncodedData, int index, char *cHout, int outputBufferSize);
+  int huffDecode(const char *huffEncodedData, int index, char *cHout, int outputBufferSize, int ninputBytes = -1);
 
   void getHuffTable(int *huffTable);
   void printTable(int *count);
@@ -68,20 +56,42 @@ public:
 
   // private atributes
 private:
-  HuffNode *globalRoot;
+  /*
+   * Entry of the decoding table. The table is indexed by the next bits of the input (first bit = lowest bit).
+   * A primary entry holds up to MAXSYMS symbols whose codes fit into PRIMARYBITS bits,
+   * longer codes are resolved by subtables of up to SUBBITS bits.
+   */
+  struct DecodeEntry {
+    unsigned char nsyms; // number of symbols, TERMINATOR, SUBTABLE or INVALID
+    unsigned char len1;  // code length of the first symbol; index bits of this table for SUBTABLE
+    unsigned char len;   // code length of all symbols; index bits of the subtable for SUBTABLE
+    unsigned char pad;
+    union {
+      unsigned char syms[4];
+      int subtable; // offset of the subtable
+    };
+  };
+
   int   *huffCode;
   int   *huffLen;
   char *bVals;
+  std::shared_ptr<const std::vector<DecodeEntry> > decodeTable; // shared by all coders with the same table
 
 
 
   static const int MAXVALUE = 256;
   static const int MAXVALUEP1 = 257;
+  static const int PRIMARYBITS = 11;
+  static const int SUBBITS = 8;
+  static const int MAXSYMS = 4;
+  static const unsigned char TERMINATOR = 0;
+  static const unsigned char SUBTABLE = 254;
+  static const unsigned char INVALID = 255;
 
 private:
-  void deleteTree(HuffNode *rootNode);
-  HuffNode *addTree(HuffNode *x, int v, int l, int info);
-  HuffNode *buildHuffmanTree();
+  std::shared_ptr<const std::vector<DecodeEntry> > getDecodeTable(const int *huffTable);
+  static int buildDecodeTable(std::vector<DecodeEntry> &table, const std::vector<int> &syms, const int *reversedCode,
+                              const int *codeLen, int shift, int bits);
   void downHeap(int *count, int *heap, int N, int k);
   void stuffInBytes(int ival, char *bvals, int offset);
 
@@ -39,11 +39,12 @@ SeisPEG::~SeisPEG() {
   if(m_pfScratch1 != NULL) delete []m_pfScratch1;
   if(m_pfScratch2 != NULL) delete []m_pfScratch2;
   delete m_hdrIntBuffer;
+  if(m_pBlockCoders != NULL) delete []m_pBlockCoders;
+  if(m_piHuffCount != NULL) delete []m_piHuffCount;
 }
 
 
 SeisPEG::SeisPEG() {
-  // todo: init m_nThreads
   m_bInit = false;
   m_bFtGainExponentWasStored = false;
   m_pFtGain = NULL;  // May remain NULL.
@@ -102,6 +103,8 @@ SeisPEG::SeisPEG(int *_huffCount, int _n1, int _n2, float _distortion,
   m_nBytesTotal = 0L;
 
   m_blockCompressor.Init(_huffCount);
+  m_piHuffCount = new int[sizeof(HuffCoder::c_huffCount) / sizeof(int)];
+  memcpy(m_piHuffCount, _huffCount, sizeof(HuffCoder::c_huffCount));
   float _ftGainExponent = 0.0F;
   Init(_n1, _n2, _distortion, _ftGainExponent, _verticalBlockSize, _horizontalBlockSize,
        _verticalTransLength, _horizontalTransLength, "full");
@@ -448,6 +451,27 @@ int SeisPEG::setGainExponent(float _ftGainExponent) {
  */
 void SeisPEG::setDelta(float _delta) {
   m_blockCompressor.setDelta(_delta);
+  m_bManualDelta = true;
+  m_fManualDelta = _delta;
+  if(m_pBlockCoders != NULL) {
+    for(int i = 0; i < m_nThreads; i++)
+      m_pBlockCoders[i].blockCompressor.setDelta(_delta);
+  }
+}
+
+
+/**
+   * Sets the number of threads used to code and decode the blocks of a frame.
+   * The compressed data is identical for any number of threads.
+   *
+   * @param  _nThreads  the number of threads (default 1).
+ */
+void SeisPEG::setNumThreads(int _nThreads) {
+  if(_nThreads < 1) _nThreads = 1;
+  if(_nThreads == m_nThreads) return;
+  if(m_pBlockCoders != NULL) delete []m_pBlockCoders;
+  m_pBlockCoders = NULL;
+  m_nThreads = _nThreads;
 }
 
 
@@ -902,8 +926,7 @@ int SeisPEG::x1Transform(int _direction, float *_paddedTraces) {
 int SeisPEG::codeAllBlocks(float *_paddedTraces, int _paddedN1, int _paddedN2,
                            float _distortion, int _verticalBlockSize, int _horizontalBlockSize,
                            char *_encodedData, int _index, int _bufferSize) {
-  // This could be threaded, but it would require us to separate all of the work buffers
-  // and the instance of BlockCompressor that is used.
+  // See codeAllBlocksParallel for the threaded version.
   int nblocksVertical = _paddedN1 / _verticalBlockSize;
   int nblocksHorizontal = _paddedN2 / _horizontalBlockSize;
 
@@ -912,6 +935,10 @@ int SeisPEG::codeAllBlocks(float *_paddedTraces, int _paddedN1, int _paddedN2,
     return JS_USERERROR;
   }
 
+  if(m_nThreads > 1 && nblocksVertical * nblocksHorizontal > 1)
+    return codeAllBlocksParallel(_paddedTraces, _paddedN1, _paddedN2, _distortion, _verticalBlockSize, _horizontalBlockSize,
+                                 _encodedData, _index, _bufferSize);
+
   int samplesPerBlock = _verticalBlockSize * _horizontalBlockSize;
   // A column is a vertical series of blocks.
   int samplesPerColumn = samplesPerBlock * nblocksVertical;
@@ -995,8 +1022,7 @@ int SeisPEG::decodeAllBlocks(float *_paddedTraces, int _paddedN1, int _paddedN2,
                              float _distortion, int _verticalBlockSize, int _horizontalBlockSize,
                              const char *_encodedData, int _index, int _bufferSize) {
 
-  // This could be threaded, but it would require us to separate all of the work buffers
-  // and the instance of BlockCompressor that is used.
+  // See decodeAllBlocksParallel for the threaded version.
   int nblocksVertical = _paddedN1 / _verticalBlockSize;
   int nblocksHorizontal = _paddedN2 / _horizontalBlockSize;
 
@@ -1005,6 +1031,10 @@ int SeisPEG::decodeAllBlocks(float *_paddedTraces, int _paddedN1, int _paddedN2,
     return JS_USERERROR;
   }
 
+  if(m_nThreads > 1 && nblocksVertical * nblocksHorizontal > 1)
+    return decodeAllBlocksParallel(_paddedTraces, _paddedN1, _paddedN2, _distortion, _verticalBlockSize, _horizontalBlockSize,
+                                   _encodedData, _index, _bufferSize);
+
   int samplesPerBlock = _verticalBlockSize * _horizontalBlockSize;
   // A column is a vertical series of blocks.
   int samplesPerColumn = samplesPerBlock * nblocksVertical;
@@ -1041,7 +1071,7 @@ int SeisPEG::decodeAllBlocks(float *_paddedTraces, int _paddedN1, int _paddedN2,
       while(ierr != JS_OK) {
         ierr = m_blockCompressor.dataDecode(_encodedData, SIZEOF_INT + encodedDataIndex,
                                             m_pcWorkBuffer2, m_nWorkBuffer2Size,
-                                            samplesPerBlock, m_pfWorkBlock);
+                                            samplesPerBlock, m_pfWorkBlock, nbytes - SIZEOF_INT);
         if(ierr != JS_OK) {
           // Buffer is too small!
           m_nWorkBuffer2Size *= 2;
@@ -1068,6 +1098,184 @@ int SeisPEG::decodeAllBlocks(float *_paddedTraces, int _paddedN1, int _paddedN2,
 
 
 
+void SeisPEG::initBlockCoders(int _samplesPerBlock) {
+  if(m_pBlockCoders != NULL && m_nBlockCoderSamples == _samplesPerBlock) return;
+  if(m_pBlockCoders != NULL) delete []m_pBlockCoders;
+  m_pBlockCoders = new BlockCoder[m_nThreads];
+  for(int i = 0; i < m_nThreads; i++) {
+    BlockCoder &coder = m_pBlockCoders[i];
+    if(m_piHuffCount != NULL) coder.blockCompressor.Init(m_piHuffCount);
+    if(m_bManualDelta) coder.blockCompressor.setDelta(m_fManualDelta);
+    coder.workBlock = new float[_samplesPerBlock];
+    // Byte block large enough to hold a block with a compression ratio of 1:1.
+    coder.workBufferSize = _samplesPerBlock * 4;
+    coder.workBuffer = new char[coder.workBufferSize];
+  }
+  m_nBlockCoderSamples = _samplesPerBlock;
+}
+
+
+/*
+ * Threaded codeAllBlocks.
+ * Each thread codes a contiguous range of blocks into its own buffer, the buffers are
+ * concatenated afterwards. The result is identical to the sequential version.
+ */
+int SeisPEG::codeAllBlocksParallel(float *_paddedTraces, int _paddedN1, int _paddedN2,
+                                   float _distortion, int _verticalBlockSize, int _horizontalBlockSize,
+                                   char *_encodedData, int _index, int _bufferSize) {
+  int nblocksVertical = _paddedN1 / _verticalBlockSize;
+  int nblocksHorizontal = _paddedN2 / _horizontalBlockSize;
+  int nblocks = nblocksVertical * nblocksHorizontal;
+
+  int samplesPerBlock = _verticalBlockSize * _horizontalBlockSize;
+  // A column is a vertical series of blocks.
+  int samplesPerColumn = samplesPerBlock * nblocksVertical;
+
+  initBlockCoders(samplesPerBlock);
+  int nThreads = (m_nThreads < nblocks) ? m_nThreads : nblocks;
+  int *nbytesCoded = new int[nThreads];
+
+  #pragma omp parallel for num_threads(nThreads) schedule(static, 1)
+  for(int t = 0; t < nThreads; t++) {
+    BlockCoder &coder = m_pBlockCoders[t];
+    int firstBlock = (long)nblocks * t / nThreads;
+    int lastBlock = (long)nblocks * (t + 1) / nThreads;
+    int codedIndex = 0;
+    for(int b = firstBlock; b < lastBlock; b++) {
+      int l = b / nblocksVertical;
+      int k = b % nblocksVertical;
+      int dataIndex = l * samplesPerColumn + k * m_nVerticalBlockSize;
+      int workBlockIndex = 0;
+      for(int j = 0; j < m_nHorizontalBlockSize; j++) {
+        for(int i = 0; i < m_nVerticalBlockSize; i++)
+          coder.workBlock[i + workBlockIndex] = _paddedTraces[i + dataIndex];
+        dataIndex += _paddedN1;
+        workBlockIndex += m_nVerticalBlockSize;
+      }
+
+      int nbytes = 0;
+      while(nbytes == 0) {
+        int nbytesAvailable = coder.workBufferSize - (codedIndex + SIZEOF_INT);
+        nbytes = coder.blockCompressor.dataEncode(coder.workBlock, samplesPerBlock, _distortion,
+                                                  coder.workBuffer, codedIndex + SIZEOF_INT, nbytesAvailable);
+        if(nbytes == 0) {
+          // Would not fit into the output buffer either.
+          if(nbytesAvailable >= _bufferSize) break;
+          // Buffer is too small!
+          char *workBuffer = new char[2 * coder.workBufferSize];
+          memcpy(workBuffer, coder.workBuffer, codedIndex);
+          delete []coder.workBuffer;
+          coder.workBuffer = workBuffer;
+          coder.workBufferSize *= 2;
+        }
+      }
+      if(nbytes <= 0) {
+        codedIndex = JS_USERERROR;
+        break;
+      }
+
+      nbytes += SIZEOF_INT;
+      // Stuff the size of the block in front of the data.
+      BlockCompressor::stuffIntInBytes(nbytes, coder.workBuffer, codedIndex);
+      codedIndex += nbytes;
+    }
+    nbytesCoded[t] = codedIndex;
+  }
+
+  int nbytesTotal = 0;
+  for(int t = 0; t < nThreads; t++) {
+    if(nbytesCoded[t] < 0) {
+      nbytesTotal = JS_USERERROR;
+      break;
+    }
+    nbytesTotal += nbytesCoded[t];
+  }
+  if(nbytesTotal < 0 || nbytesTotal > _bufferSize) {
+    ERROR_PRINTF(SeisPEGLog, "Encoded data doesn't fit into %d bytes", _bufferSize);
+    delete []nbytesCoded;
+    return JS_USERERROR;// Overflow!
+  }
+
+  int encodedDataIndex = _index;
+  for(int t = 0; t < nThreads; t++) {
+    memcpy(&_encodedData[encodedDataIndex], m_pBlockCoders[t].workBuffer, nbytesCoded[t]);
+    encodedDataIndex += nbytesCoded[t];
+  }
+  delete []nbytesCoded;
+
+  return nbytesTotal;
+}
+
+
+/*
+ * Threaded decodeAllBlocks.
+ * The block offsets are collected from the size stored in front of each block,
+ * then contiguous ranges of blocks are decoded in parallel.
+ */
+int SeisPEG::decodeAllBlocksParallel(float *_paddedTraces, int _paddedN1, int _paddedN2,
+                                     float _distortion, int _verticalBlockSize, int _horizontalBlockSize,
+                                     const char *_encodedData, int _index, int _bufferSize) {
+  int nblocksVertical = _paddedN1 / _verticalBlockSize;
+  int nblocksHorizontal = _paddedN2 / _horizontalBlockSize;
+  int nblocks = nblocksVertical * nblocksHorizontal;
+
+  int samplesPerBlock = _verticalBlockSize * _horizontalBlockSize;
+  // A column is a vertical series of blocks.
+  int samplesPerColumn = samplesPerBlock * nblocksVertical;
+
+  int *blockIndex = new int[nblocks];
+  int encodedDataIndex = _index;
+  for(int b = 0; b < nblocks; b++) {
+    int nbytes = BlockCompressor::stuffBytesInInt(_encodedData, encodedDataIndex);
+    if(nbytes < SIZEOF_INT || (encodedDataIndex - _index) + nbytes > _bufferSize) {
+      ERROR_PRINTF(SeisPEGLog, "encodedDataIndex-index)+nbytes > bufferSize");
+      delete []blockIndex;
+      return JS_USERERROR;// Overflow!
+    }
+    blockIndex[b] = encodedDataIndex;
+    encodedDataIndex += nbytes;
+  }
+
+  initBlockCoders(samplesPerBlock);
+  int nThreads = (m_nThreads < nblocks) ? m_nThreads : nblocks;
+
+  #pragma omp parallel for num_threads(nThreads) schedule(static, 1)
+  for(int t = 0; t < nThreads; t++) {
+    BlockCoder &coder = m_pBlockCoders[t];
+    int firstBlock = (long)nblocks * t / nThreads;
+    int lastBlock = (long)nblocks * (t + 1) / nThreads;
+    for(int b = firstBlock; b < lastBlock; b++) {
+      int ierr = -1;
+      while(ierr != JS_OK) {
+        ierr = coder.blockCompressor.dataDecode(_encodedData, SIZEOF_INT + blockIndex[b],
+                                                coder.workBuffer, coder.workBufferSize, samplesPerBlock, coder.workBlock,
+                                                BlockCompressor::stuffBytesInInt(_encodedData, blockIndex[b]) - SIZEOF_INT);
+        if(ierr != JS_OK) {
+          // Buffer is too small!
+          coder.workBufferSize *= 2;
+          delete []coder.workBuffer;
+          coder.workBuffer = new char[coder.workBufferSize];
+        }
+      }
+
+      int l = b / nblocksVertical;
+      int k = b % nblocksVertical;
+      int dataIndex = l * samplesPerColumn + k * m_nVerticalBlockSize;
+      int workBlockIndex = 0;
+      for(int j = 0; j < m_nHorizontalBlockSize; j++) {
+        for(int i = 0; i < m_nVerticalBlockSize; i++)
+          _paddedTraces[i + dataIndex] = coder.workBlock[i + workBlockIndex];
+        dataIndex += _paddedN1;
+        workBlockIndex += m_nVerticalBlockSize;
+      }
+    }
+  }
+  delete []blockIndex;
+
+  return encodedDataIndex - _index;
+}
+
+
 /**
    * Stores values in the header of the encoded data.
    *
@@ -1508,6 +1716,7 @@ int SeisPEG::compress(float *_traces, int _nTraces, IntBuffer *_hdrIntBuffer, in
 */
 int SeisPEG::uncompressHdrs(const char *_encodedBytes, int _nBytes, int *_hdrs, int _hdrLength) {
   decodeHdr(_encodedBytes, m_piHdrInfo);
+  if(m_piHdrInfo[IND_NBYTES_HDRS] == 0) return 0; // the frame was compressed without headers
   uncompress(_encodedBytes, _nBytes, NULL, 0);
   int nBytesTraces = m_piHdrInfo[IND_NBYTES_TRACES];
   int nBytesHdrs = m_piHdrInfo[IND_NBYTES_HDRS];
@@ -1532,6 +1741,7 @@ int SeisPEG::uncompress(const char *_compressedByteData, int _compressedDataLeng
   uncompress(_compressedByteData, _compressedDataLength, _traces, _nTraces);
   int nBytesTraces = m_piHdrInfo[IND_NBYTES_TRACES];
   int nBytesHdrs = m_piHdrInfo[IND_NBYTES_HDRS];
+  if(nBytesHdrs == 0) return 0; // the frame was compressed without headers
   return m_hdrCompressor.uncompress(_compressedByteData, nBytesTraces, nBytesHdrs,
                                     _hdrIntBuffer, _hdrLength, _traces, _nTraces, m_n1);
 }
@@ -1543,6 +1753,7 @@ int SeisPEG::uncompress(const char *_compressedByteData, int _compressedDataLeng
   uncompress(_compressedByteData, _compressedDataLength, _traces, _nTraces);
   int nBytesTraces = m_piHdrInfo[IND_NBYTES_TRACES];
   int nBytesHdrs = m_piHdrInfo[IND_NBYTES_HDRS];
+  if(nBytesHdrs == 0) return 0; // the frame was compressed without headers
   return m_hdrCompressor.uncompress(_compressedByteData, nBytesTraces, nBytesHdrs,
                                     _hdrIntBufArray, _hdrLength, _traces, _nTraces, m_n1);
 }
@@ -73,6 +73,8 @@ public:
 
   int setGainExponent(float _ftGainExponent);
   void setDelta(float _delta);
+  void setNumThreads(int _nThreads);
+  int getNumThreads() const {return m_nThreads;};
   long compressedByteBufferAllocSize();
 
 
@@ -125,6 +127,16 @@ private:
                       float _distortion, int _verticalBlockSize, int _horizontalBlockSize,
                       const char *_encodedData, int _index, int _bufferSize);
 
+  int codeAllBlocksParallel(float *_paddedTraces, int _paddedN1, int _paddedN2,
+                            float _distortion, int _verticalBlockSize, int _horizontalBlockSize,
+                            char *_encodedData, int _index, int _bufferSize);
+
+  int decodeAllBlocksParallel(float *_paddedTraces, int _paddedN1, int _paddedN2,
+                              float _distortion, int _verticalBlockSize, int _horizontalBlockSize,
+                              const char *_encodedData, int _index, int _bufferSize);
+
+  void initBlockCoders(int _samplesPerBlock);
+
   int timeTransform(int direction, float *paddedTraces);
   int x1Transform(int direction, float *paddedTraces);
 
@@ -194,7 +206,24 @@ private:
 
   bool m_bInit;
 
-  int m_nThreads;
+  int m_nThreads { 1 };
+
+  // Per-thread state of codeAllBlocksParallel/decodeAllBlocksParallel.
+  struct BlockCoder {
+    ~BlockCoder() {
+      if(workBlock != NULL) delete []workBlock;
+      if(workBuffer != NULL) delete []workBuffer;
+    }
+    BlockCompressor blockCompressor;
+    float *workBlock { };  // Length of samples per block.
+    char *workBuffer { };  // Encoded blocks (coding) or a decompressed block (decoding).
+    int workBufferSize { };
+  };
+  BlockCoder *m_pBlockCoders { };
+  int m_nBlockCoderSamples { };
+  int *m_piHuffCount { };  // Copy of the Huffman table if not the default one.
+  bool m_bManualDelta { };
+  float m_fManualDelta { };
 
   static const int FORWARD =  1;
   static const int REVERSE = -1;
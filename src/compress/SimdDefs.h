@@ -0,0 +1,50 @@
+/***************************************************************************
+                           SimdDefs.h  -  description
+                             -------------------
+ * Vector types and runtime CPU dispatch used by the SeisPEG kernels.
+
+    copyright            : (C) 2012 Fraunhofer ITWM
+
+    This file is part of jseisIO.
+
+    jseisIO is free software: you can redistribute it and/or modify
+    it under the terms of the Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    jseisIO is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    Lesser General Public License for more details.
+
+    You should have received a copy of the Lesser General Public License
+    along with jseisIO.  If not, see <http://www.gnu.org/licenses/>.
+
+ ***************************************************************************/
+
+#ifndef  SIMDDEFS_H
+#define  SIMDDEFS_H
+
+/*
+ * On x86-64 (gcc) AVX-512, AVX2 and SSE2 versions of a function marked with JS_TARGET_CLONES
+ * are compiled and the best one supported by the CPU is selected at runtime.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && __GNUC__ >= 6
+#define JS_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define JS_TARGET_CLONES
+#endif
+
+// __builtin_convertvector (int <-> float <-> double vectors)
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9)
+#define JS_HAVE_CONVERTVECTOR 1
+#endif
+
+namespace jsIO {
+typedef float v8sf __attribute__((vector_size(32)));
+typedef float v16sf __attribute__((vector_size(64)));
+typedef int v8si __attribute__((vector_size(32)));
+typedef double v8df __attribute__((vector_size(64)));
+}
+
+#endif
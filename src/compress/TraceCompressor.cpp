@@ -133,7 +133,7 @@ int TraceCompressor::Init(DataFormat _traceFormat, int _numSamples, CharBuffer *
     recordLengthInBytes = (4 * numWindows) + (bytesPerSample * numSamplesX);
     //             printf("numWindows=%d, numSamplesX=%d\n",numWindows, numSamplesX);
     scalars = new float[numWindows];
-    buffer08 = new char[numSamplesX];
+    buffer08 = new char[numSamplesX](); // the padding is written as is
     _bufferByte->asByteBuffer(bufferViewByte);
     _bufferByte->asFloatBuffer(bufferViewFloat);
     recordLengthInFloats = (int) recordLengthInBytes / 4;
@@ -26,12 +26,14 @@
 
 
 #include "Transformer.h"
+#include "SimdDefs.h"
 #include "../PSProLogging.h"
 
 namespace jsIO {
 DECLARE_LOGGER(TransformerLog);
 
 bool Transformer::c_integrityTest = false;
+bool Transformer::c_vectorized = true;
 
 float Transformer::globalFilt8[64] = {
   FILT0,   FILT1,   FILT2,   FILT3,   FILT4,   FILT5,   FILT6,   FILT7,
@@ -110,6 +112,147 @@ float Transformer::globalFilt16[256] = {
     0.11961393058300018F,  0.33970499038696289F,  0.05408555269241333F,  0.30441030859947205F
   };
 
+/*
+ * Vectorized block kernels of lotFwd8/lotRev8/lotFwd16/lotRev16.
+ * One block (8 or 16 samples) is transformed per vector operation, see the scalar code for the algorithm.
+ * Every output is summed in the same order as in the scalar code and no fused multiply-add is used,
+ * so the results are bit-identical.
+ */
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+
+// x[k..k+7] = sum_j filt[8j..8j+7] * (dp_j, dm_j, dp_j, dm_j, ...) for each block
+JS_TARGET_CLONES
+static void lotFwd8Blocks(float *x, const float *scratch, int nsamps, const float *filt) {
+  v8sf rows[8];
+  for(int j = 0; j < 8; j++) memcpy(&rows[j], &filt[8 * j], sizeof(v8sf));
+
+  for(int i = 0; i < nsamps; i += 8) {
+    const float *s = &scratch[i];
+    float dp = s[0] + s[15];
+    float dm = s[0] - s[15];
+    v8sf d = {dp, dm, dp, dm, dp, dm, dp, dm};
+    v8sf out = rows[0] * d;
+    for(int j = 1; j < 8; j++) {
+      dp = s[j] + s[15 - j];
+      dm = s[j] - s[15 - j];
+      v8sf dj = {dp, dm, dp, dm, dp, dm, dp, dm};
+      out += rows[j] * dj;
+    }
+    memcpy(&x[i], &out, sizeof(v8sf));
+  }
+}
+
+JS_TARGET_CLONES
+static void lotRev8Blocks(const float *x, float *scratch, int nblocks, const float *filt) {
+  // cols[c][m] = filt[8m+c]
+  v8sf cols[8];
+  for(int c = 0; c < 8; c++)
+    for(int m = 0; m < 8; m++) cols[c][m] = filt[8 * m + c];
+
+  int nblocksM1 = nblocks - 1;
+  for(int i = 0; i < nblocks; i++) {
+    const float *xb = &x[8 * i];
+    float *s = &scratch[8 * i];
+
+    // It's faster not to check the DC, since it's almost surely non-zero. Ditto for x[1].
+    v8sf tmpA = cols[0] * xb[0];
+    if(ISNOTZERO(xb[2])) tmpA += cols[2] * xb[2];
+    if(ISNOTZERO(xb[4])) tmpA += cols[4] * xb[4];
+    if(ISNOTZERO(xb[6])) tmpA += cols[6] * xb[6];
+    v8sf tmpB = cols[1] * xb[1];
+    if(ISNOTZERO(xb[3])) tmpB += cols[3] * xb[3];
+    if(ISNOTZERO(xb[5])) tmpB += cols[5] * xb[5];
+    if(ISNOTZERO(xb[7])) tmpB += cols[7] * xb[7];
+
+    v8sf diff = tmpA - tmpB;
+    for(int m = 0; m < 8; m++) s[15 - m] = diff[m];
+    tmpB += tmpA;
+
+    if(i == 0) {
+      /* Left edge. */
+      for(int m = 0; m < 4; m++) s[4 + m] = tmpB[3 - m];
+    }
+
+    v8sf sv;
+    memcpy(&sv, s, sizeof(v8sf));
+    sv += tmpB;
+    memcpy(s, &sv, sizeof(v8sf));
+
+    if(i == nblocksM1) {
+      /* Right edge (last time thru loop). */
+      for(int m = 0; m < 4; m++) s[8 + m] += s[15 - m];
+    }
+  }
+}
+
+// x[k..k+15] = sum_m filt[16m..16m+15] * (dp_m, dm_m, dp_m, dm_m, ...) for each block
+JS_TARGET_CLONES
+static void lotFwd16Blocks(float *x, const float *scratch, int nsamps, const float *filt) {
+  v16sf rows[16];
+  for(int m = 0; m < 16; m++) memcpy(&rows[m], &filt[16 * m], sizeof(v16sf));
+
+  for(int i = 0; i < nsamps; i += 16) {
+    const float *s = &scratch[i];
+    float dp = s[0] + s[31];
+    float dm = s[0] - s[31];
+    v16sf d = {dp, dm, dp, dm, dp, dm, dp, dm, dp, dm, dp, dm, dp, dm, dp, dm};
+    v16sf out = rows[0] * d;
+    for(int m = 1; m < 16; m++) {
+      dp = s[m] + s[31 - m];
+      dm = s[m] - s[31 - m];
+      v16sf dj = {dp, dm, dp, dm, dp, dm, dp, dm, dp, dm, dp, dm, dp, dm, dp, dm};
+      out += rows[m] * dj;
+    }
+    memcpy(&x[i], &out, sizeof(v16sf));
+  }
+}
+
+JS_TARGET_CLONES
+static void lotRev16Blocks(const float *x, float *scratch, int nblocks, const float *filt) {
+  // cols[c][j] = filt[16j+c], i.e. the coefficients of x[c] in tmp(2j) (c even) or tmp(2j+1) (c odd)
+  v16sf cols[16];
+  for(int c = 0; c < 16; c++)
+    for(int j = 0; j < 16; j++) cols[c][j] = filt[16 * j + c];
+
+  int nblocksM1 = nblocks - 1;
+  for(int i = 0; i < nblocks; i++) {
+    const float *xb = &x[16 * i];
+    float *s = &scratch[16 * i];
+
+    // tmpA[j] = tmp(2j), tmpB[j] = tmp(2j+1) of the scalar code
+    v16sf tmpA = {};
+    v16sf tmpB = {};
+    if(ISNOTZERO(xb[0])) tmpA = cols[0] * xb[0];
+    if(ISNOTZERO(xb[1])) tmpB = cols[1] * xb[1];
+    for(int c = 2; c < 16; c += 2) {
+      if(ISNOTZERO(xb[c])) tmpA += cols[c] * xb[c];
+      if(ISNOTZERO(xb[c + 1])) tmpB += cols[c + 1] * xb[c + 1];
+    }
+
+    v16sf sum = tmpA + tmpB;
+    v16sf diff = tmpA - tmpB;
+    if(i == 0) {
+      /* Left edge. */
+      for(int j = 0; j < 8; j++) s[8 + j] = sum[7 - j];
+    }
+
+    v16sf sv;
+    memcpy(&sv, s, sizeof(v16sf));
+    sv += sum;
+    memcpy(s, &sv, sizeof(v16sf));
+    for(int j = 0; j < 16; j++) s[31 - j] = diff[j];
+
+    if(i == nblocksM1) {
+      /* Right edge (last time thru loop). */
+      for(int j = 0; j < 8; j++) s[16 + j] += diff[j];
+    }
+  }
+}
+
+#pragma GCC pop_options
+
+
 Transformer::~Transformer() {
   delete []tmp;
 }
@@ -166,6 +309,11 @@ void Transformer::lotFwd8(float *x, int index, int nblocks, float *scratch) {
 
   for(i = 0; i < nsamps; i++) scratch[i + 4] = x[i + index];
 
+  if(c_vectorized) {
+    lotFwd8Blocks(&x[index], scratch, nsamps, globalFilt8);
+    return;
+  }
+
   k = 0;
   /* One loop for each block of samples. */
   for(i = 0; i < nsamps; i += 8) {
@@ -255,6 +403,12 @@ void Transformer::lotRev8(float *x, int index, int nblocks, float *scratch) {
   nsamps = nblocks << 3;   /* nsamps = nblocks * 8 */
   nblocksM1 = nblocks - 1;
 
+  if(c_vectorized) {
+    lotRev8Blocks(&x[index], scratch, nblocks, globalFilt8);
+    for(i = 0; i < nsamps; i++) x[i + index] = scratch[i + 4];
+    return;
+  }
+
   int xIndex = index;
   int scratchIndex = 0;
 
@@ -463,6 +617,11 @@ void Transformer::lotFwd16(float *x, int index, int nblocks, float *scratch) {
 
   for(i = 0; i < nsamps; i++) scratch[i + 8] = x[i + index];
 
+  if(c_vectorized) {
+    lotFwd16Blocks(&x[index], scratch, nsamps, globalFilt16);
+    return;
+  }
+
   k = 0;
   for(i = 0; i < nsamps; i += 16) {
     /*
@@ -575,6 +734,12 @@ void Transformer::lotRev16(float *x, int index, int nblocks, float *scratch) {
 
   if(allZeros) return;
 
+  if(c_vectorized) {
+    lotRev16Blocks(&x[index], scratch, nblocks, globalFilt16);
+    for(i = 0; i < nsamps; i++) x[i + index] = scratch[i + 8];
+    return;
+  }
+
   int xIndex = index;
   int scratchIndex = 0;
 
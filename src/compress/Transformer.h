@@ -50,6 +50,8 @@ public:
   int lotRev(float *x, int index, int blockSize, int transLength, int nblocks, float *scratch);
 public:
   static bool c_integrityTest;
+  // Use the vectorized kernels of the transforms and of the BlockCompressor quantization (default).
+  static bool c_vectorized;
   // private atributes
 private:
   void lotFwd8(float *x, int index, int nblocks, float *scratch);
@@ -33,6 +33,45 @@ enum JS_ERROR_TYPE {
   JS_OK = 1, JS_FATALERROR = -1, JS_USERERROR = -2, JS_WARNING = -3
 };
 
+/**
+ * Durability policy of jsFileWriter, i.e. how often written extents are flushed to disk (fsync)
+ */
+enum JS_SYNC_POLICY {
+  JS_SYNC_PER_FRAME = 0, JS_SYNC_PER_NFRAMES = 1, JS_SYNC_PER_VOLUME = 2, JS_SYNC_ON_CLOSE = 3
+};
+
+/**
+ * Access pattern of the memory-mapped read mode of jsFileReader (passed to madvise)
+ */
+enum JS_ACCESS_PATTERN {
+  JS_ACCESS_NORMAL = 0, JS_ACCESS_SEQUENTIAL = 1, JS_ACCESS_RANDOM = 2
+};
+
+/**
+ * Page replacement policy of the read cache of jsFileReader
+ */
+enum JS_CACHE_POLICY {
+  JS_CACHE_LRU = 0, JS_CACHE_CLOCK = 1
+};
+
+/**
+ * Statistics of a read cache of jsFileReader (see jsFileReader::getIOCacheStats)
+ */
+struct JS_CACHE_STATS {
+  long hits;        // page accesses served from the cache
+  long misses;      // pages read from disk
+  long evictions;   // cached pages replaced by other pages
+  long directReads; // reads of a page size or more, which bypass the cache
+  long bytesRead;   // bytes read from disk
+};
+
+/**
+ * Backend of the bulk extent reads and writes of jsFileReader and jsFileWriter (see setIOBackend)
+ */
+enum JS_IO_BACKEND {
+  JS_IO_PREAD = 0, JS_IO_URING = 1
+};
+
 #define ISNOTZERO(A) ((A)<0.f || (A)>0.f)
 
 #endif
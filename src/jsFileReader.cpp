@@ -27,6 +27,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "jsFileReader.h"
 #include "GridDefinition.h"
@@ -35,10 +40,16 @@
 #include "FileProperties.h"
 #include "CustomProperties.h"
 #include "TraceMap.h"
+#include "MappedExtents.h"
+#include "FrameBufferPool.h"
 #include "compress/TraceCompressor.h"
 #include "compress/SeisPEG.h"
 
 #include "IOCachedReader.h"
+#include "SharedBlockCache.h"
+#include "IOBackend.h"
+#include "DirectIO.h"
+#include "FramePrefetcher.h"
 
 #include "PSProLogging.h"
 #include "ExtentList.h"
@@ -48,6 +59,15 @@
 namespace jsIO {
 DECLARE_LOGGER(jsFileReaderLog);
 
+// page size of the read caches if not set by setIOCache
+static const unsigned long DEFAULT_IO_PAGE_SIZE = 256 * 1024;
+// TraceMaps up to this size are kept in memory (see setTraceMapCache)
+static const long MAX_WHOLE_TRACEMAP_SIZE = 256L * 1024 * 1024;
+// size of the requests a large read is split into with the io_uring backend
+static const long IO_BACKEND_REQUEST_SIZE = 1024 * 1024;
+// size of the uncompressed frames readHyperslab reads at once
+static const long HYPERSLAB_BATCH_SIZE = 64L * 1024 * 1024;
+
 jsFileReader::~jsFileReader() {
   Close();
 }
@@ -56,6 +76,9 @@ jsFileReader::jsFileReader(const unsigned long _bufferSize) {
   m_curr_trffd = -1;
   m_curr_trhfd = -1;
   m_IOBufferSize = _bufferSize;
+  m_IOPageSize = std::min(_bufferSize, DEFAULT_IO_PAGE_SIZE);
+  m_IONumPages = (m_IOPageSize > 0) ? _bufferSize / m_IOPageSize : 0;
+  m_IOCachePolicy = JS_CACHE_LRU;
   m_frameInd = -1;
   m_frameHeaderInd = -1;
 }
@@ -77,6 +100,11 @@ void jsFileReader::closefp() {
 }
 
 void jsFileReader::Close() {
+  stopPrefetch();
+  unmapExtents();
+  m_lastView.release();
+  m_viewPool.reset();
+
   if(m_traceBufferArray != NULL) {
     delete[] m_traceBufferArray;
     m_traceBufferArray = NULL;
@@ -137,6 +165,13 @@ void jsFileReader::Close() {
   }
 
   closefp();
+  closeSharedFds();
+  std::vector<long>().swap(m_liveTracePrefix);
+
+  if(m_pIOBackend != NULL) {
+    delete m_pIOBackend;
+    m_pIOBackend = NULL;
+  }
 
   if(m_pCachedReaderHD != NULL) {
     delete m_pCachedReaderHD;
@@ -157,9 +192,10 @@ void jsFileReader::Close() {
   m_bInit = false;
 }
 
-int jsFileReader::Init(const std::string _jsfilename, const int _NThreads, int wait) {
+int jsFileReader::Init(const std::string _jsfilename, const int _NThreads, int wait, bool _directIO) {
   TRACE_PRINTF(jsFileReaderLog, "Init JS_Reader : %s", _jsfilename.c_str());
   Close();
+  m_bDirectIO = _directIO;
 
   m_filename = _jsfilename;
   if(m_filename[m_filename.length() - 1] != '/') m_filename.append(1, '/');
@@ -272,8 +308,10 @@ int jsFileReader::Init(const std::string _jsfilename, const int _NThreads, int w
 
   m_TotalNumOfTraces = m_TotalNumOfFrames * m_fileProps->axisLengths[1];
 
-  m_pCachedReaderHD = new IOCachedReader(-1, m_IOBufferSize, 1);
-  m_pCachedReaderTR = new IOCachedReader(-1, m_IOBufferSize, 1);
+  m_pCachedReaderHD = new IOCachedReader(m_IOPageSize, m_IONumPages, m_IOCachePolicy);
+  m_pCachedReaderTR = new IOCachedReader(m_IOPageSize, m_IONumPages, m_IOCachePolicy);
+  m_pCachedReaderHD->setSharedCache(m_pSharedCache);
+  m_pCachedReaderTR->setSharedCache(m_pSharedCache);
 
   //*** check Regularity and compute total number of live traces
   if(m_fileProps->isMapped == false) {  //if not mapped, then it must be regular
@@ -289,32 +327,31 @@ int jsFileReader::Init(const std::string _jsfilename, const int _NThreads, int w
     //if so, then it is not regular, otherwise regular
     m_bIsMapped = true;
     m_bIsRegular = true;
-    std::ifstream ifile;
-    std::string fname = m_filename + JS_TRACE_MAP;
-    ifile.open(fname.c_str(), std::ifstream::in);
-    if(!ifile.good()) {
-      ERROR_PRINTF(jsFileReaderLog, "Invalid JavaSeis Format. Error while opening file %s", fname.c_str());
+    m_trMap = new TraceMap;
+    int trMap_numDim = m_fileProps->numDimensions;
+    long *trMap_axes = new long[trMap_numDim];
+    for(int i = 0; i < trMap_numDim; i++)
+      trMap_axes[i] = m_fileProps->axisLengths[i];
+    ires = m_trMap->Init(trMap_axes, trMap_numDim, m_byteOrder, m_filename, "r");
+    delete[] trMap_axes;
+    if(ires != JS_OK) {
+      ERROR_PRINTF(jsFileReaderLog, "Invalid JavaSeis Format. Error while opening TraceMap of %s", m_filename.c_str());
       return JS_USERERROR;
     }
 
-    int numReadedInts = 0;
-    int maxInt2read = 4096;
-    int *iBuffer = new int[maxInt2read];
+    // small maps are kept in memory, gigantic ones (or incomplete ones) are read a volume at a time
+    if(m_bWholeTraceMap && m_TotalNumOfFrames * (long)sizeof(int) <= MAX_WHOLE_TRACEMAP_SIZE) m_trMap->loadAll();
+
     m_TotalNumOfLiveTraces = 0;
-    while(ifile.good() && numReadedInts < m_TotalNumOfFrames) {
-      int ints2Read = (m_TotalNumOfFrames - numReadedInts > maxInt2read) ? maxInt2read : m_TotalNumOfFrames - numReadedInts;
-      ifile.read((char*)iBuffer, ints2Read * sizeof(int));
-      for(int i = 0; i < ints2Read; i++) {
-        m_TotalNumOfLiveTraces += iBuffer[i];
-        if(iBuffer[i] != m_numTraces) {
-          m_bIsRegular = false;
-          //              TRACE_PRINTF(jsFileReaderLog, "Not Regular %d!=%d", iBuffer[i],m_numTraces);
-        }
+    const int *folds = m_trMap->getAllFoldsArray();
+    for(long i = 0; i < m_TotalNumOfFrames; i++) {
+      int fold = (folds != NULL) ? folds[i] : m_trMap->getFold(i);
+      m_TotalNumOfLiveTraces += fold;
+      if(fold != m_numTraces) {
+        m_bIsRegular = false;
+        //              TRACE_PRINTF(jsFileReaderLog, "Not Regular %d!=%d", fold,m_numTraces);
       }
-      numReadedInts += ints2Read;
     }
-    ifile.close();
-    delete[] iBuffer;
   }
   //***
   TRACE_PRINTF(jsFileReaderLog, "Data Format=%s", m_fileProps->traceFormat.getName().c_str());
@@ -337,26 +374,6 @@ int jsFileReader::Init(const std::string _jsfilename, const int _NThreads, int w
     m_headerBuffer[i].asIntBuffer(m_headerBufferView[i]);
   }
 
-  if(m_bIsMapped) {
-    m_trMap = new TraceMap;
-    int trMap_numDim = m_fileProps->numDimensions;
-    long *trMap_axes = new long[trMap_numDim];
-    for(int i = 0; i < trMap_numDim; i++)
-      trMap_axes[i] = m_fileProps->axisLengths[i];
-
-    m_trMap->Init(trMap_axes, trMap_numDim, m_byteOrder, m_filename, "r");
-
-    delete[] trMap_axes;
-  }
-
-  m_prev_firstTr1 = 0;
-  m_prev_numTraces1 = 0;
-  m_prev_frInd1 = 0;
-
-  m_prev_firstTr2 = 0;
-  m_prev_numTraces2 = 0;
-  m_prev_frInd2 = 0;
-
   if(m_fileProps->traceFormat.getName() != DataFormat::SEISPEG.getName()) {
     m_traceCompressor = new TraceCompressor[m_NThreads];
     for(int i = 0; i < m_NThreads; i++) {
@@ -638,6 +655,30 @@ long jsFileReader::readTraceHeaders(const long _firstTraceIndex, const long _num
   return nReadTraces;
 }
 
+int jsFileReader::buildLiveTraceIndex() {
+  // the TraceMap loads the folds of a volume at a time, read contexts use it concurrently
+  std::lock_guard<std::mutex> lock(m_trMapMutex);
+  if(!m_liveTracePrefix.empty()) return JS_OK;
+
+  std::vector<long> prefix(m_TotalNumOfFrames + 1);
+  prefix[0] = 0;
+  for(long frInd = 0; frInd < m_TotalNumOfFrames; frInd++) {
+    int numLiveTraces = m_trMap->getFold(frInd);
+    if(numLiveTraces < 0 || numLiveTraces > m_numTraces) {
+      ERROR_PRINTF(jsFileReaderLog, "Corrupted TraceMap");
+      return JS_USERERROR;
+    }
+    prefix[frInd + 1] = prefix[frInd] + numLiveTraces;
+  }
+  if(prefix[m_TotalNumOfFrames] != m_TotalNumOfLiveTraces) {
+    ERROR_PRINTF(jsFileReaderLog, "Corrupted TraceMap: %ld live traces, expected %ld", prefix[m_TotalNumOfFrames],
+                 m_TotalNumOfLiveTraces);
+    return JS_USERERROR;
+  }
+  m_liveTracePrefix.swap(prefix);
+  return JS_OK;
+}
+
 int jsFileReader::liveToGlobalTraceIndex(const long _liveTraceIndex, long &_globalTraceIndex) {
   if(!m_bInit) {
     ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
@@ -648,64 +689,41 @@ int jsFileReader::liveToGlobalTraceIndex(const long _liveTraceIndex, long &_glob
     return JS_USERERROR;
   }
 
-  long frameInd; //index of the frame where trace with the index _liveTraceIndex is located
-  int trInd; //index of the trace # _liveTraceIndex  within the frame with index frameInd
-
   if(m_bIsRegular) {
     _globalTraceIndex = _liveTraceIndex;
   } else {
-    long numTraces = 0;
-    long frInd = 0;
-    int nTookFrom = 0;
-
-    if(_liveTraceIndex < m_prev_firstTr1 || (m_prev_firstTr1 == 0 && m_prev_firstTr2 == 0)) {
-      nTookFrom = 0;
-    } else if(_liveTraceIndex >= m_prev_firstTr2) {
-      numTraces = m_prev_numTraces2;
-      frInd = m_prev_frInd2;
-      nTookFrom = 2;
-    } else if(_liveTraceIndex >= m_prev_firstTr1) {
-      numTraces = m_prev_numTraces1;
-      frInd = m_prev_frInd1;
-      nTookFrom = 1;
-    }
-
-    int numLiveTraces; //number of live traces in current frame
-    numLiveTraces = m_trMap->getFold(frInd);
-    do {
-      numLiveTraces = m_trMap->getFold(frInd);
-      if(numLiveTraces < 0) {
-        ERROR_PRINTF(jsFileReaderLog, "Corrupted TraceMap");
-        return JS_USERERROR;
-      }
-      numTraces += numLiveTraces;
-      frInd++;
-    } while(numTraces <= _liveTraceIndex);
-
-    frameInd = frInd - 1;
-    trInd = _liveTraceIndex - (numTraces - numLiveTraces);
-
-    if(nTookFrom == 0) {
-      m_prev_firstTr1 = _liveTraceIndex;
-      m_prev_numTraces1 = numTraces - numLiveTraces;
-      m_prev_frInd1 = frameInd;
-
-      m_prev_firstTr2 = _liveTraceIndex;
-      m_prev_numTraces2 = numTraces - numLiveTraces;
-      m_prev_frInd2 = frameInd;
-    } else if(nTookFrom == 1) {
-      m_prev_firstTr1 = _liveTraceIndex;
-      m_prev_numTraces1 = numTraces - numLiveTraces;
-      m_prev_frInd1 = frameInd;
-    } else if(nTookFrom == 2) {
-      m_prev_firstTr2 = _liveTraceIndex;
-      m_prev_numTraces2 = numTraces - numLiveTraces;
-      m_prev_frInd2 = frameInd;
-    }
+    if(buildLiveTraceIndex() != JS_OK) return JS_USERERROR;
+    // frame with the last prefix <= _liveTraceIndex, i.e. the live trace is in this frame
+    long frameInd = std::upper_bound(m_liveTracePrefix.begin(), m_liveTracePrefix.end(), _liveTraceIndex)
+        - m_liveTracePrefix.begin() - 1;
+    _globalTraceIndex = frameInd * (long)m_numTraces + (_liveTraceIndex - m_liveTracePrefix[frameInd]);
+  }
+  return JS_OK;
+}
 
-    _globalTraceIndex = frameInd * (long)m_numTraces + trInd;
+int jsFileReader::globalToLiveTraceIndex(const long _globalTraceIndex, long &_liveTraceIndex) {
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(_globalTraceIndex < 0 || _globalTraceIndex >= m_TotalNumOfTraces) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid trace index. %ld must be in [0,%ld)", _globalTraceIndex, m_TotalNumOfTraces);
+    return JS_USERERROR;
   }
-  //     printf(" _liveTraceIndex=%ld, _globalTraceIndex=%ld\n", _liveTraceIndex, _globalTraceIndex);
+
+  if(m_bIsRegular) {
+    _liveTraceIndex = _globalTraceIndex;
+    return JS_OK;
+  }
+  if(buildLiveTraceIndex() != JS_OK) return JS_USERERROR;
+  long frameInd = _globalTraceIndex / m_numTraces;
+  long trInd = _globalTraceIndex - frameInd * m_numTraces;
+  long numLiveTraces = m_liveTracePrefix[frameInd + 1] - m_liveTracePrefix[frameInd];
+  if(trInd >= numLiveTraces) {
+    _liveTraceIndex = m_liveTracePrefix[frameInd + 1];
+    return JS_WARNING;
+  }
+  _liveTraceIndex = m_liveTracePrefix[frameInd] + trInd;
   return JS_OK;
 }
 
@@ -1036,10 +1054,19 @@ int jsFileReader::readFrame(const long _frameIndex, float *frame, char *headbuf)
 
   long glb_offset = _frameIndex * m_frameSize;
   int numLiveTraces = getNumOfLiveTraces(_frameIndex);
-  if(numLiveTraces == 0) return 0;
 
   long bytesInFrame = (long)numLiveTraces * (long)m_compess_traceSize;
 
+  bool bPrefetched = false;
+  if(m_pPrefetcher != NULL && frame != NULL) {
+    if(numLiveTraces > 0) {
+      char *rawframe = m_bIsFloat ? (char*)frame : &m_traceBufferArray[0];
+      bPrefetched = m_pPrefetcher->fetch(_frameIndex, rawframe, bytesInFrame);
+    }
+    m_pPrefetcher->access(_frameIndex);
+  }
+  if(numLiveTraces == 0) return 0;
+
   if(headbuf != NULL && !m_bSeisPEG_data) {
     long glb_head_offset = _frameIndex * m_frameHeaderLength;
     long bytesInHeaderFrame = numLiveTraces * m_headerLengthBytes;
@@ -1054,18 +1081,22 @@ int jsFileReader::readFrame(const long _frameIndex, float *frame, char *headbuf)
 
   if(frame) { // skip reading data if it's nullptr
     if(m_bIsFloat) { //if float, there is no need to uncompress, we can read directly into frame (should be faster)
-      int ires = readTraceBuffer(glb_offset, (char*)frame, bytesInFrame);
-      if(ires != JS_OK) {
-        ERROR_PRINTF(jsFileReaderLog, "Can't read frame from %s", m_filename.c_str());
-        return ires;
+      if(!bPrefetched) {
+        int ires = readTraceBuffer(glb_offset, (char*)frame, bytesInFrame);
+        if(ires != JS_OK) {
+          ERROR_PRINTF(jsFileReaderLog, "Can't read frame from %s", m_filename.c_str());
+          return ires;
+        }
       }
       if(nativeOrder() != m_byteOrder) endian_swap((void*)frame, m_numSamples * m_numTraces, sizeof(float));
     } else {
       //read gather from the TraceFile(s)
-      int ires = readTraceBuffer(glb_offset, &m_traceBufferArray[0], bytesInFrame);
-      if(ires != JS_OK) {
-        ERROR_PRINTF(jsFileReaderLog, "Can't read frame from %s", m_filename.c_str());
-        return ires;
+      if(!bPrefetched) {
+        int ires = readTraceBuffer(glb_offset, &m_traceBufferArray[0], bytesInFrame);
+        if(ires != JS_OK) {
+          ERROR_PRINTF(jsFileReaderLog, "Can't read frame from %s", m_filename.c_str());
+          return ires;
+        }
       }
       //if dataFormat is not FLOAT - uncompress
       if(m_bSeisPEG_data) {
@@ -1151,7 +1182,11 @@ long jsFileReader::getTraceIndex(const int *position) const { // *position must
 
 int jsFileReader::getNumOfLiveTraces(int _frameIndex) const {
   int numLiveTraces = m_numTraces;
-  if(!m_bIsRegular) numLiveTraces = m_trMap->getFold(_frameIndex);
+  if(!m_bIsRegular) {
+    // the TraceMap loads the folds of a volume at a time, read contexts call this concurrently
+    std::lock_guard<std::mutex> lock(m_trMapMutex);
+    numLiveTraces = m_trMap->getFold(_frameIndex);
+  }
   return numLiveTraces;
 }
 
@@ -1254,27 +1289,809 @@ int jsFileReader::uncompressRawFrame(char *rawframe, int numLiveTraces, int iThr
 
   if(m_bIsFloat) {  //if float, there is no need to uncompress, we can read directly into frame (should be faster)
     memcpy((char*)frame, (char*)rawframe, m_numSamples * numLiveTraces * sizeof(float));
-    if(nativeOrder() != m_byteOrder) endian_swap((void*)rawframe, m_numSamples * numLiveTraces, sizeof(float));
+    if(nativeOrder() != m_byteOrder) endian_swap((void*)frame, m_numSamples * numLiveTraces, sizeof(float));
+  } else {
+    uncompressFrame(rawframe, numLiveTraces, iThread, frame, headbuf);
+  }
 
+  return numLiveTraces;
+}
+
+//uncompress a non-FLOAT raw frame using the compressor of thread iThread
+//headbuf is filled for SeisPEG data only and may be NULL
+void jsFileReader::uncompressFrame(char *rawframe, int numLiveTraces, int iThread, float *frame, char *headbuf) {
+  if(m_bSeisPEG_data) {
+    if(headbuf != NULL) {
+      m_seispegCompressor[iThread].uncompress(rawframe, m_frameSize, frame, numLiveTraces, (int*)headbuf, m_headerLengthWords);
+      if(nativeOrder() != m_byteOrder) m_traceProps->swapHeaders(headbuf, numLiveTraces);
+    } else m_seispegCompressor[iThread].uncompress(rawframe, m_frameSize, frame, numLiveTraces);
   } else {
-    //if dataFormat is not FLOAT - uncompress
-    if(m_bSeisPEG_data) {
-      if(headbuf != NULL) {
-        m_seispegCompressor[iThread].uncompress(rawframe, m_frameSize, frame, numLiveTraces, (int*)headbuf, m_headerLengthWords);
-        if(nativeOrder() != m_byteOrder) m_traceProps->swapHeaders(headbuf, numLiveTraces);
-      } else m_seispegCompressor[iThread].uncompress(rawframe, m_frameSize, frame, numLiveTraces);
+    m_traceCompressor[iThread].updateBuffer(rawframe, m_frameSize);
+    m_traceCompressor[iThread].unpackFrame(numLiveTraces, frame);
+  }
+}
+
+long jsFileReader::readFrames(const long _frameIndex, int _NFrames, float *frames, char *headbuf, int *numLiveTraces) {
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(_frameIndex < 0 || _NFrames < 1 || _frameIndex + _NFrames > m_TotalNumOfFrames) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid frame range. [%ld,%ld) must be in [0,%ld)", _frameIndex, _frameIndex + _NFrames,
+                 m_TotalNumOfFrames);
+    return JS_USERERROR;
+  }
+
+  int *nLive = new int[_NFrames];
+  // FLOAT frames are stored as they are, so they are read in place
+  char *rawframes = m_bIsFloat ? (char*)frames : new char[_NFrames * m_frameSize];
+  int ires = readRawFrames(_frameIndex, _NFrames, rawframes, nLive);
+  if(ires != JS_OK) {
+    ERROR_PRINTF(jsFileReaderLog, "Can't read %d frames starting from frame %ld from %s", _NFrames, _frameIndex, m_filename.c_str());
+    if(!m_bIsFloat) delete[] rawframes;
+    delete[] nLive;
+    return ires;
+  }
+
+  if(headbuf != NULL && !m_bSeisPEG_data) {
+    // the header frames are stored contiguously with the same layout as in headbuf
+    ires = readHeaderBuffer(_frameIndex * m_frameHeaderLength, headbuf, _NFrames * m_frameHeaderLength);
+    if(ires != JS_OK) {
+      ERROR_PRINTF(jsFileReaderLog, "Can't read headers of %d frames starting from frame %ld from %s", _NFrames, _frameIndex,
+                   m_filename.c_str());
+      if(!m_bIsFloat) delete[] rawframes;
+      delete[] nLive;
+      return ires;
+    }
+  }
+
+  uncompressFrames(_NFrames, nLive, rawframes, frames, headbuf);
+  if(!m_bIsFloat) delete[] rawframes;
+
+  long numTraces = 0;
+  for(int i = 0; i < _NFrames; i++) {
+    numTraces += nLive[i];
+    if(numLiveTraces != NULL) numLiveTraces[i] = nLive[i];
+  }
+  delete[] nLive;
+  return numTraces;
+}
+
+long jsFileReader::readFrameList(const long *_frameIndices, int _NFrames, float *frames, char *headbuf, int *numLiveTraces) {
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(_NFrames < 1) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid number of frames %d", _NFrames);
+    return JS_USERERROR;
+  }
+  int *nLive = new int[_NFrames];
+  for(int i = 0; i < _NFrames; i++) {
+    if(_frameIndices[i] < 0 || _frameIndices[i] >= m_TotalNumOfFrames) {
+      ERROR_PRINTF(jsFileReaderLog, "Invalid frame index. %ld must be in [0,%ld)", _frameIndices[i], m_TotalNumOfFrames);
+      delete[] nLive;
+      return JS_USERERROR;
+    }
+    nLive[i] = getNumOfLiveTraces(_frameIndices[i]);
+  }
+
+  // read in file order
+  std::vector<int> order(_NFrames);
+  for(int i = 0; i < _NFrames; i++)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [_frameIndices](int a, int b) {
+    return _frameIndices[a] < _frameIndices[b];
+  });
+
+  // FLOAT frames are stored as they are, so they are read in place
+  char *rawframes = m_bIsFloat ? (char*)frames : new char[_NFrames * m_frameSize];
+  int ires = readFrameRanges(false, _frameIndices, order, nLive, rawframes, m_frameSize);
+  if(ires == JS_OK && headbuf != NULL && !m_bSeisPEG_data)
+    ires = readFrameRanges(true, _frameIndices, order, nLive, headbuf, m_frameHeaderLength);
+  if(ires != JS_OK) {
+    ERROR_PRINTF(jsFileReaderLog, "Can't read a list of %d frames from %s", _NFrames, m_filename.c_str());
+    if(!m_bIsFloat) delete[] rawframes;
+    delete[] nLive;
+    return ires;
+  }
+
+  uncompressFrames(_NFrames, nLive, rawframes, frames, headbuf);
+  if(!m_bIsFloat) delete[] rawframes;
+
+  long numTraces = 0;
+  for(int i = 0; i < _NFrames; i++) {
+    numTraces += nLive[i];
+    if(numLiveTraces != NULL) numLiveTraces[i] = nLive[i];
+  }
+  delete[] nLive;
+  return numTraces;
+}
+
+long jsFileReader::readHyperslab(const int *_start, const int *_count, const int *_stride, float *buffer, char *headbuf) {
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  int numAxis = m_fileProps->numDimensions;
+  std::vector<int> stride(numAxis, 1);
+  long numFrames = 1;
+  for(int i = 0; i < numAxis; i++) {
+    if(_stride != NULL) stride[i] = _stride[i];
+    if(_start[i] < 0 || _count[i] < 1 || stride[i] < 1
+        || _start[i] + (long)(_count[i] - 1) * stride[i] >= m_fileProps->axisLengths[i]) {
+      ERROR_PRINTF(jsFileReaderLog, "Invalid hyperslab along axis %d: start %d, count %d, stride %d (axis length %ld)", i, _start[i],
+                   _count[i], stride[i], (long)m_fileProps->axisLengths[i]);
+      return JS_USERERROR;
+    }
+    if(i >= 2) numFrames *= _count[i];
+  }
+
+  // global indices of the frames in the order of the output, which is the file order
+  std::vector<long> frameIndices(numFrames);
+  std::vector<int> pos(numAxis, 0);
+  for(long k = 0; k < numFrames; k++) {
+    long frameIndex = 0;
+    long volsize = 1;
+    for(int i = 2; i < numAxis; i++) {
+      frameIndex += (_start[i] + (long)pos[i] * stride[i]) * volsize;
+      volsize *= m_fileProps->axisLengths[i];
+    }
+    frameIndices[k] = frameIndex;
+    for(int i = 2; i < numAxis && ++pos[i] == _count[i]; i++)
+      pos[i] = 0;
+  }
+
+  // the live traces of a non-full frame are left-justified, they are put at the positions given by their trace-axis header
+  vector<string> axisHdrs;
+  jseisUtil::getAxisHdrs(*this, axisHdrs);
+  catalogedHdrEntry traceHdr = getHdrEntry(axisHdrs[1]);
+  long traceOrigin = m_fileProps->logicalOrigins[1];
+  long traceDelta = m_fileProps->logicalDeltas[1];
+
+  // traces after the last requested one of full frames are neither read nor uncompressed
+  // (non-full frames are needed whole for their headers, SeisPEG frames can only be uncompressed whole)
+  int lastTrace = _start[1] + (_count[1] - 1) * stride[1];
+  long frameLen = (long)m_numSamples * m_numTraces;
+  int batch = (int)std::min(numFrames, std::max((long)m_NThreads, HYPERSLAB_BATCH_SIZE / (frameLen * (long)sizeof(float))));
+  std::vector<float> frames(batch * frameLen);
+  std::vector<char> headers;
+  char *rawframes = m_bIsFloat ? (char*)&frames[0] : new char[batch * m_frameSize];
+  std::vector<int> order(batch);
+  std::vector<int> nLive(batch);
+  std::vector<char> full(batch);
+  long numTraces = 0;
+  for(long k0 = 0; k0 < numFrames; k0 += batch) {
+    int nf = (int)std::min((long)batch, numFrames - k0);
+    bool nonFull = false;
+    order.resize(nf);
+    for(int i = 0; i < nf; i++) {
+      order[i] = i;
+      nLive[i] = getNumOfLiveTraces(frameIndices[k0 + i]);
+      full[i] = (nLive[i] == m_numTraces);
+      if(!full[i]) nonFull = true;
+      else if(!m_bSeisPEG_data) nLive[i] = std::min(nLive[i], lastTrace + 1);
+    }
+    bool withHeaders = headbuf != NULL || nonFull;
+    if(withHeaders && headers.empty()) headers.resize(batch * m_frameHeaderLength);
+
+    int ires = readFrameRanges(false, &frameIndices[k0], order, &nLive[0], rawframes, m_frameSize);
+    if(ires == JS_OK && withHeaders && !m_bSeisPEG_data)
+      ires = readFrameRanges(true, &frameIndices[k0], order, &nLive[0], &headers[0], m_frameHeaderLength);
+    if(ires != JS_OK) {
+      ERROR_PRINTF(jsFileReaderLog, "Can't read a hyperslab of %ld frames from %s", numFrames, m_filename.c_str());
+      if(!m_bIsFloat) delete[] rawframes;
+      return ires;
+    }
+    // SeisPEG traces uncompressed with their headers would be remuted, unlike by readFrame(f, frame),
+    // so the headers needed are uncompressed on their own
+    uncompressFrames(nf, &nLive[0], rawframes, &frames[0], (withHeaders && !m_bSeisPEG_data) ? &headers[0] : NULL);
+    if(withHeaders && m_bSeisPEG_data) {
+#pragma omp parallel for num_threads(m_NThreads) schedule(dynamic)
+      for(int i = 0; i < nf; i++) {
+        if(nLive[i] <= 0 || (full[i] && headbuf == NULL)) continue;
+        int iThread = 0;
+#ifdef _OPENMP
+        iThread = omp_get_thread_num();
+#endif
+        char *frameHeader = &headers[i * m_frameHeaderLength];
+        if(m_seispegCompressor[iThread].uncompressHdrs(&rawframes[i * m_frameSize], m_frameSize, (int*)frameHeader,
+                                                       m_headerLengthBytes) <= 0)
+          memset(frameHeader, 0, nLive[i] * m_headerLengthBytes); // compressed without headers
+        else if(nativeOrder() != m_byteOrder) m_traceProps->swapHeaders(frameHeader, nLive[i]);
+      }
+    }
+
+#pragma omp parallel num_threads(m_NThreads) reduction(+:numTraces)
+    {
+      std::vector<int> liveIndex(m_numTraces); // index of the live trace at each position of a non-full frame, -1 if dead
+#pragma omp for schedule(dynamic)
+      for(int i = 0; i < nf; i++) {
+        if(!full[i]) {
+          std::fill(liveIndex.begin(), liveIndex.end(), -1);
+          for(int r = 0; r < nLive[i]; r++) {
+            long i2 = (traceDelta == 0) ? r
+                : lrint((traceHdr.getLongVal(&headers[i * m_frameHeaderLength + r * m_headerLengthBytes]) - traceOrigin)
+                        / (double)traceDelta);
+            if(i2 >= 0 && i2 < m_numTraces) liveIndex[i2] = r;
+          }
+        }
+        for(int j = 0; j < _count[1]; j++) {
+          int itr = _start[1] + j * stride[1];
+          int r = full[i] ? itr : liveIndex[itr];
+          long outTrace = (k0 + i) * _count[1] + j;
+          float *out = &buffer[outTrace * _count[0]];
+          char *outHeader = (headbuf != NULL) ? &headbuf[outTrace * m_headerLengthBytes] : NULL;
+          if(r < 0) {
+            memset(out, 0, _count[0] * sizeof(float));
+            if(outHeader != NULL) memset(outHeader, 0, m_headerLengthBytes);
+            continue;
+          }
+          const float *trace = &frames[(i * m_numTraces + r) * (long)m_numSamples + _start[0]];
+          if(stride[0] == 1) memcpy(out, trace, _count[0] * sizeof(float));
+          else for(int s = 0; s < _count[0]; s++)
+            out[s] = trace[(long)s * stride[0]];
+          if(outHeader != NULL) memcpy(outHeader, &headers[i * m_frameHeaderLength + r * m_headerLengthBytes], m_headerLengthBytes);
+          numTraces++;
+        }
+      }
+    }
+  }
+  if(!m_bIsFloat) delete[] rawframes;
+  return numTraces;
+}
+
+/*
+ * Reads the live part of the frames _frameIndices[_order[i]] from the TraceFile(s) (or TraceHeaders) into
+ * _buf + _order[i] * _stride. Consecutive frames located in one extent are read with one vectored read,
+ * the reads are executed by the I/O backend.
+ */
+int jsFileReader::readFrameRanges(bool _header, const long *_frameIndices, const std::vector<int> &_order, const int *nLive,
+    char *_buf, long _stride) {
+  long bytesPerTrace = _header ? m_headerLengthBytes : m_compess_traceSize;
+  if((_header ? m_pMappedHD : m_pMappedTR) != NULL || m_bDirectIO) { // copy from the mappings or read aligned
+    for(size_t k = 0; k < _order.size(); k++) {
+      int i = _order[k];
+      if(nLive[i] <= 0) continue;
+      int ires = _header ? readHeaderBuffer(_frameIndices[i] * _stride, &_buf[i * _stride], nLive[i] * bytesPerTrace)
+          : readTraceBuffer(_frameIndices[i] * _stride, &_buf[i * _stride], nLive[i] * bytesPerTrace);
+      if(ires != JS_OK) return ires;
+    }
+    return JS_OK;
+  }
+
+  struct Run {
+    int extInd;
+    long offset; // in the extent
+    long end;    // global offset after the last iovec
+    std::vector<struct iovec> iov;
+  };
+  ExtentList *extents = _header ? m_TrHeadExtents : m_TrFileExtents;
+  std::vector<Run> runs;
+  long prevFrame = -2;
+  for(size_t k = 0; k < _order.size(); k++) {
+    int i = _order[k];
+    if(nLive[i] <= 0) continue;
+    long start = _frameIndices[i] * _stride;
+    long len = nLive[i] * bytesPerTrace;
+    char *dst = &_buf[i * _stride];
+    bool bNext = (_frameIndices[i] == prevFrame + 1);
+    prevFrame = _frameIndices[i];
+    while(len > 0) {
+      int extInd = extents->getExtentIndex(start + 1);
+      if(extInd < 0) return JS_USERERROR;
+      long extStart = (*extents)[extInd].getStartOffset();
+      long chunk = std::min(len, extStart + (*extents)[extInd].getExtentSize() - start);
+      Run *run = runs.empty() ? NULL : &runs.back();
+      if(run != NULL && bNext && run->extInd == extInd && start >= run->end) {
+        // the dead traces of the previous frame are read into the unused end of its buffer
+        run->iov.back().iov_len += start - run->end;
+      } else {
+        runs.push_back(Run());
+        run = &runs.back();
+        run->extInd = extInd;
+        run->offset = start - extStart;
+      }
+      struct iovec v;
+      v.iov_base = dst;
+      v.iov_len = chunk;
+      run->iov.push_back(v);
+      run->end = start + chunk;
+      start += chunk;
+      dst += chunk;
+      len -= chunk;
+      bNext = false;
+    }
+  }
+
+  if(runs.empty()) return JS_OK;
+  std::vector<IORequest> reqs(runs.size());
+  for(size_t r = 0; r < runs.size(); r++) {
+    reqs[r].fd = getSharedFd(_header, runs[r].extInd);
+    if(reqs[r].fd < 0) return JS_WARNING;
+    reqs[r].iov = &runs[r].iov[0];
+    reqs[r].iovcnt = runs[r].iov.size();
+    reqs[r].offset = runs[r].offset;
+  }
+  return getBackend()->read(&reqs[0], reqs.size());
+}
+
+// uncompresses (or byte-swaps) _NFrames raw frames read into rawframes (frames if FLOAT) in parallel
+void jsFileReader::uncompressFrames(int _NFrames, const int *nLive, char *rawframes, float *frames, char *headbuf) {
+  long frameLen = (long)m_numSamples * m_numTraces;
+  bool bSwap = nativeOrder() != m_byteOrder;
+#pragma omp parallel for num_threads(m_NThreads) schedule(dynamic)
+  for(int i = 0; i < _NFrames; i++) {
+    int iThread = 0;
+#ifdef _OPENMP
+    iThread = omp_get_thread_num();
+#endif
+    if(nLive[i] <= 0) continue;
+    float *frame = &frames[i * frameLen];
+    char *frameHeader = (headbuf != NULL) ? &headbuf[i * m_frameHeaderLength] : NULL;
+    if(m_bIsFloat) {
+      if(bSwap) endian_swap((void*)frame, (long)nLive[i] * m_numSamples, sizeof(float));
     } else {
-      m_traceCompressor[iThread].updateBuffer(rawframe, m_frameSize);
-      m_traceCompressor[iThread].unpackFrame(numLiveTraces, frame);
+      uncompressFrame(&rawframes[i * m_frameSize], nLive[i], iThread, frame, m_bSeisPEG_data ? frameHeader : NULL);
     }
+    if(frameHeader != NULL && !m_bSeisPEG_data && bSwap) m_traceProps->swapHeaders(frameHeader, nLive[i]);
   }
 
+  // uncompressFrame re-targets the trace compressors, let them view the internal buffers again
+  if(!m_bIsFloat && !m_bSeisPEG_data) {
+    for(int i = 0; i < m_NThreads; i++)
+      m_traceCompressor[i].updateBuffer(&m_traceBufferArray[i * m_frameSize], m_frameSize);
+  }
+}
+
+int jsFileReader::setPrefetch(int _depth) {
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(_depth < 0) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid read-ahead depth %d", _depth);
+    return JS_USERERROR;
+  }
+  stopPrefetch();
+  m_prefetchHits = 0;
+  m_prefetchMisses = 0;
+  if(_depth == 0) return JS_OK;
+
+  // the background thread can't share the file descriptors and caches of this reader
+  m_pPrefetchReader = new jsFileReader(m_IOBufferSize);
+  m_pPrefetchReader->setIOCache(m_IOPageSize, m_IONumPages, m_IOCachePolicy);
+  m_pPrefetchReader->m_pSharedCache = m_pSharedCache;
+  m_pPrefetchReader->setIOBackend(m_IOBackendType, m_IOQueueDepth);
+  m_pPrefetchReader->m_bWholeTraceMap = m_bWholeTraceMap;
+  int ires = m_pPrefetchReader->Init(m_filename, 1, 0, m_bDirectIO);
+  if(ires != JS_OK) {
+    ERROR_PRINTF(jsFileReaderLog, "Can't open %s for read-ahead", m_filename.c_str());
+    delete m_pPrefetchReader;
+    m_pPrefetchReader = NULL;
+    return ires;
+  }
+  jsFileReader *reader = m_pPrefetchReader;
+  m_pPrefetcher = new FramePrefetcher(_depth, m_frameSize, m_TotalNumOfFrames, [reader](long frameIndex, char *rawframe, int *numLiveTraces) {
+    return reader->readRawFrames(frameIndex, 1, rawframe, numLiveTraces);
+  });
+  return JS_OK;
+}
+
+void jsFileReader::stopPrefetch() {
+  if(m_pPrefetcher != NULL) {
+    m_prefetchHits = m_pPrefetcher->getHits();
+    m_prefetchMisses = m_pPrefetcher->getMisses();
+    delete m_pPrefetcher;
+    m_pPrefetcher = NULL;
+  }
+  if(m_pPrefetchReader != NULL) {
+    delete m_pPrefetchReader;
+    m_pPrefetchReader = NULL;
+  }
+}
+
+int jsFileReader::setSeisPEGThreads(int _nThreads) {
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(_nThreads < 1) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid number of threads %d", _nThreads);
+    return JS_USERERROR;
+  }
+  // readFrame uses the first compressor only
+  if(m_bSeisPEG_data) m_seispegCompressor[0].setNumThreads(_nThreads);
+  return JS_OK;
+}
+
+int jsFileReader::setIOCache(unsigned long _pageSize, int _numPages, JS_CACHE_POLICY _policy) {
+  if(_numPages < 0 || (_pageSize > 0 && _numPages == 0)) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid number of cache pages %d", _numPages);
+    return JS_USERERROR;
+  }
+  m_IOPageSize = _pageSize;
+  m_IONumPages = (_pageSize > 0) ? _numPages : 0;
+  m_IOCachePolicy = _policy;
+  m_IOBufferSize = m_IOPageSize * m_IONumPages;
+  if(m_pCachedReaderTR == NULL) return JS_OK;
+
+  // the extent files are opened again on the next read
+  delete m_pCachedReaderTR;
+  delete m_pCachedReaderHD;
+  m_pCachedReaderHD = new IOCachedReader(m_IOPageSize, m_IONumPages, m_IOCachePolicy);
+  m_pCachedReaderTR = new IOCachedReader(m_IOPageSize, m_IONumPages, m_IOCachePolicy);
+  m_pCachedReaderHD->setSharedCache(m_pSharedCache);
+  m_pCachedReaderTR->setSharedCache(m_pSharedCache);
+  m_currIndexOfTrFileExtent = -1;
+  m_currIndexOfTrHeadExtent = -1;
+  return JS_OK;
+}
+
+void jsFileReader::getIOCacheStats(JS_CACHE_STATS &_traceStats, JS_CACHE_STATS &_headerStats) const {
+  _traceStats = (m_pCachedReaderTR != NULL) ? m_pCachedReaderTR->getStats() : JS_CACHE_STATS();
+  _headerStats = (m_pCachedReaderHD != NULL) ? m_pCachedReaderHD->getStats() : JS_CACHE_STATS();
+}
+
+int jsFileReader::configureSharedCache(unsigned long _budget, unsigned long _blockSize, int _numShards) {
+  return SharedBlockCache::configure(_budget, _blockSize, _numShards);
+}
+
+void jsFileReader::getSharedCacheStats(JS_CACHE_STATS &_stats) {
+  std::shared_ptr<SharedBlockCache> cache = SharedBlockCache::getInstance();
+  _stats = (cache != NULL) ? cache->getStats() : JS_CACHE_STATS();
+}
+
+int jsFileReader::attachSharedCache(bool _attach) {
+  std::shared_ptr<SharedBlockCache> cache;
+  if(_attach) {
+    cache = SharedBlockCache::getInstance();
+    if(cache == NULL) {
+      ERROR_PRINTF(jsFileReaderLog, "The shared block cache is not configured (see configureSharedCache)");
+      return JS_USERERROR;
+    }
+  }
+  m_pSharedCache = cache;
+  if(m_pCachedReaderTR == NULL) return JS_OK;
+
+  // the file keys change, so the extent files are opened again on the next read
+  m_pCachedReaderHD->setSharedCache(m_pSharedCache);
+  m_pCachedReaderTR->setSharedCache(m_pSharedCache);
+  m_currIndexOfTrFileExtent = -1;
+  m_currIndexOfTrHeadExtent = -1;
+  return JS_OK;
+}
+
+int jsFileReader::setIOBackend(JS_IO_BACKEND _type, int _queueDepth) {
+  if(_queueDepth < 1) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid queue depth %d", _queueDepth);
+    return JS_USERERROR;
+  }
+  m_IOBackendType = _type;
+  m_IOQueueDepth = _queueDepth;
+  if(m_pIOBackend != NULL) {
+    delete m_pIOBackend;
+    m_pIOBackend = NULL;
+  }
+  return JS_OK;
+}
+
+JS_IO_BACKEND jsFileReader::getIOBackend() {
+  return getBackend()->getType();
+}
+
+bool jsFileReader::bypassesCache(long _buflen) const {
+  unsigned long pageSize = (m_pSharedCache != NULL) ? m_pSharedCache->getBlockSize() : m_IOPageSize;
+  return pageSize == 0 || (unsigned long)_buflen >= pageSize;
+}
+
+IOBackend *jsFileReader::getBackend() {
+  if(m_pIOBackend == NULL) m_pIOBackend = IOBackend::create(m_IOBackendType, m_IOQueueDepth, m_NThreads);
+  return m_pIOBackend;
+}
+
+/*
+ * Reads _buflen bytes at the global offset _offset from the TraceFile(s) (or TraceHeaders) through the I/O
+ * backend, split into requests of IO_BACKEND_REQUEST_SIZE bytes which are in flight together.
+ */
+int jsFileReader::readBufferDirect(bool _header, long _offset, char *_buf, long _buflen) {
+  ExtentList *extents = _header ? m_TrHeadExtents : m_TrFileExtents;
+  std::vector<struct iovec> iov;
+  std::vector<IORequest> reqs;
+  while(_buflen > 0) {
+    int extInd = extents->getExtentIndex(_offset + 1);
+    if(extInd < 0) {
+      ERROR_PRINTF(jsFileReaderLog, "Can't read %ld bytes starting from offset %ld", _buflen, _offset);
+      return JS_USERERROR;
+    }
+    int fd = getSharedFd(_header, extInd);
+    if(fd < 0) return JS_WARNING;
+    long extStart = (*extents)[extInd].getStartOffset();
+    long len = std::min(std::min(_buflen, IO_BACKEND_REQUEST_SIZE), extStart + (*extents)[extInd].getExtentSize() - _offset);
+    struct iovec v;
+    v.iov_base = _buf;
+    v.iov_len = len;
+    iov.push_back(v);
+    IORequest req;
+    req.fd = fd;
+    req.iovcnt = 1;
+    req.offset = _offset - extStart;
+    reqs.push_back(req);
+    _offset += len;
+    _buf += len;
+    _buflen -= len;
+  }
+  if(reqs.empty()) return JS_OK;
+  for(size_t i = 0; i < reqs.size(); i++)
+    reqs[i].iov = &iov[i];
+  return getBackend()->read(&reqs[0], reqs.size());
+}
+
+int jsFileReader::setTraceMapCache(bool _wholeMap) {
+  m_bWholeTraceMap = _wholeMap;
+  if(m_trMap == NULL) return JS_OK;
+  std::lock_guard<std::mutex> lock(m_trMapMutex);
+  if(!_wholeMap) {
+    m_trMap->releaseAll();
+    return JS_OK;
+  }
+  return m_trMap->loadAll();
+}
+
+int jsFileReader::setMmap(bool _enable, JS_ACCESS_PATTERN _access) {
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(!_enable) {
+    unmapExtents();
+    return JS_OK;
+  }
+  if(m_pMappedTR != NULL) {
+    m_pMappedTR->setAccessPattern(_access);
+    m_pMappedHD->setAccessPattern(_access);
+    return JS_OK;
+  }
+  m_pMappedTR = std::make_shared<MappedExtents>(m_TrFileExtents, _access);
+  m_pMappedHD = std::make_shared<MappedExtents>(m_TrHeadExtents, _access);
+  return JS_OK;
+}
+
+void jsFileReader::unmapExtents() {
+  // views still pointing into the mappings keep them alive
+  m_pMappedTR.reset();
+  m_pMappedHD.reset();
+  m_lastView.release();
+  if(m_mappedFrameCopy != NULL) {
+    delete[] m_mappedFrameCopy;
+    m_mappedFrameCopy = NULL;
+  }
+  if(m_mappedHeaderCopy != NULL) {
+    delete[] m_mappedHeaderCopy;
+    m_mappedHeaderCopy = NULL;
+  }
+}
+
+int jsFileReader::getMappedFrame(const long _frameIndex, const char *&traces, const char **headbuf) {
+  traces = NULL;
+  if(headbuf != NULL) *headbuf = NULL;
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(m_pMappedTR == NULL) {
+    ERROR_PRINTF(jsFileReaderLog, "The memory-mapped read mode is not enabled (see setMmap)");
+    return JS_USERERROR;
+  }
+  std::string format = m_fileProps->traceFormat.getName();
+  int sampleSize = 0;
+  if(format == DataFormat::FLOAT.getName()) sampleSize = sizeof(float);
+  else if(format == DataFormat::INT16.getName()) sampleSize = sizeof(short);
+  else if(format == DataFormat::INT08.getName()) sampleSize = sizeof(char);
+  else {
+    ERROR_PRINTF(jsFileReaderLog, "getMappedFrame supports uncompressed data only, the data format is %s", format.c_str());
+    return JS_USERERROR;
+  }
+  if(_frameIndex < 0 || _frameIndex >= m_TotalNumOfFrames) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid frame index. %ld must be in [0,%ld)\n", _frameIndex, m_TotalNumOfFrames);
+    return JS_USERERROR;
+  }
+
+  int numLiveTraces = getNumOfLiveTraces(_frameIndex);
+  if(numLiveTraces <= 0) return numLiveTraces;
+  bool bSwap = nativeOrder() != m_byteOrder;
+
+  long bytesInFrame = (long)numLiveTraces * m_compess_traceSize;
+  traces = m_pMappedTR->getPointer(_frameIndex * m_frameSize, bytesInFrame);
+  if(traces == NULL || (bSwap && sampleSize > 1)) {
+    if(m_mappedFrameCopy == NULL) m_mappedFrameCopy = new char[m_frameSize];
+    int ires = readTraceBuffer(_frameIndex * m_frameSize, m_mappedFrameCopy, bytesInFrame);
+    if(ires != JS_OK) {
+      ERROR_PRINTF(jsFileReaderLog, "Can't read frame from %s", m_filename.c_str());
+      traces = NULL;
+      return ires;
+    }
+    if(bSwap && sampleSize > 1) endian_swap((void*)m_mappedFrameCopy, bytesInFrame / sampleSize, sampleSize);
+    traces = m_mappedFrameCopy;
+  }
+
+  if(headbuf != NULL) {
+    long bytesInHeaderFrame = (long)numLiveTraces * m_headerLengthBytes;
+    *headbuf = m_pMappedHD->getPointer(_frameIndex * m_frameHeaderLength, bytesInHeaderFrame);
+    if(*headbuf == NULL || bSwap) {
+      if(m_mappedHeaderCopy == NULL) m_mappedHeaderCopy = new char[m_frameHeaderLength];
+      int ires = readHeaderBuffer(_frameIndex * m_frameHeaderLength, m_mappedHeaderCopy, bytesInHeaderFrame);
+      if(ires != JS_OK) {
+        ERROR_PRINTF(jsFileReaderLog, "Can't read frame header from %s", m_filename.c_str());
+        traces = NULL;
+        *headbuf = NULL;
+        return ires;
+      }
+      if(bSwap) m_traceProps->swapHeaders(m_mappedHeaderCopy, numLiveTraces);
+      *headbuf = m_mappedHeaderCopy;
+    }
+  }
   return numLiveTraces;
 }
 
+ReadContext *jsFileReader::createReadContext() {
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return NULL;
+  }
+  ReadContext *context = new ReadContext(this);
+  if(context->init() != JS_OK) {
+    ERROR_PRINTF(jsFileReaderLog, "Can't create a read context for %s", m_filename.c_str());
+    delete context;
+    return NULL;
+  }
+  return context;
+}
+
+int jsFileReader::getSharedFd(bool _header, int _extInd, bool _direct) {
+  if(_direct && !m_bDirectIO) return -1;
+  std::lock_guard<std::mutex> lock(m_sharedFdMutex);
+  ExtentList *extents = _header ? m_TrHeadExtents : m_TrFileExtents;
+  if(_direct) {
+    std::vector<int> &fds = _header ? m_sharedHdDirectFds : m_sharedTrDirectFds;
+    if(fds.empty()) fds.assign(extents->getNumExtents(), -1);
+    if(fds[_extInd] == -1) {
+      fds[_extInd] = openDirect((*extents)[_extInd].getPath().c_str(), O_RDONLY);
+      if(fds[_extInd] < 0) fds[_extInd] = -2; // read buffered
+    }
+    return fds[_extInd];
+  }
+  std::vector<int> &fds = _header ? m_sharedHdFds : m_sharedTrFds;
+  if(fds.empty()) fds.assign(extents->getNumExtents(), -1);
+  if(fds[_extInd] < 0) {
+    std::string fname = (*extents)[_extInd].getPath();
+    fds[_extInd] = ::open(fname.c_str(), O_RDONLY);
+    if(fds[_extInd] < 0) ERROR_PRINTF(jsFileReaderLog, "Can't open %s", fname.c_str());
+  }
+  return fds[_extInd];
+}
+
+void jsFileReader::closeSharedFds() {
+  std::lock_guard<std::mutex> lock(m_sharedFdMutex);
+  for(size_t i = 0; i < m_sharedTrFds.size(); i++)
+    if(m_sharedTrFds[i] >= 0) ::close(m_sharedTrFds[i]);
+  for(size_t i = 0; i < m_sharedHdFds.size(); i++)
+    if(m_sharedHdFds[i] >= 0) ::close(m_sharedHdFds[i]);
+  for(size_t i = 0; i < m_sharedTrDirectFds.size(); i++)
+    if(m_sharedTrDirectFds[i] >= 0) ::close(m_sharedTrDirectFds[i]);
+  for(size_t i = 0; i < m_sharedHdDirectFds.size(); i++)
+    if(m_sharedHdDirectFds[i] >= 0) ::close(m_sharedHdDirectFds[i]);
+  m_sharedTrFds.clear();
+  m_sharedHdFds.clear();
+  m_sharedTrDirectFds.clear();
+  m_sharedHdDirectFds.clear();
+}
+
+int jsFileReader::getFrameView(const long _frameIndex, FrameView &view, bool _withHeaders) {
+  view.release();
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(_frameIndex < 0 || _frameIndex >= m_TotalNumOfFrames) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid frame index. %ld must be in [0,%ld)\n", _frameIndex, m_TotalNumOfFrames);
+    return JS_USERERROR;
+  }
+  if(m_lastView.m_frameIndex == _frameIndex
+      && (!_withHeaders || m_lastView.m_headers != NULL || m_lastView.m_numLiveTraces == 0)) {
+    view = m_lastView;
+    return view.m_numLiveTraces;
+  }
+  if(m_viewPool == NULL) m_viewPool = std::make_shared<FrameBufferPool>((long)m_numSamples * m_numTraces, m_frameHeaderLength);
+
+  int numLiveTraces = getNumOfLiveTraces(_frameIndex);
+  if(numLiveTraces < 0) return numLiveTraces;
+
+  FrameView newView;
+  newView.m_frameIndex = _frameIndex;
+  newView.m_numLiveTraces = numLiveTraces;
+  newView.m_numSamples = m_numSamples;
+  newView.m_headerLength = m_headerLengthBytes;
+
+  if(numLiveTraces == 0) {
+    newView.m_owner = m_viewPool;
+  } else {
+    const char *traces = NULL;
+    const char *headers = NULL;
+    if(m_pMappedTR != NULL && m_bIsFloat && nativeOrder() == m_byteOrder) {
+      traces = m_pMappedTR->getPointer(_frameIndex * m_frameSize, (long)numLiveTraces * m_compess_traceSize);
+      if(traces != NULL && _withHeaders)
+        headers = m_pMappedHD->getPointer(_frameIndex * m_frameHeaderLength, (long)numLiveTraces * m_headerLengthBytes);
+    }
+
+    std::shared_ptr<FrameData> data;
+    if(traces != NULL && (headers != NULL || !_withHeaders)) {
+      data = std::make_shared<FrameData>();
+    } else {
+      data = m_viewPool->get(_withHeaders);
+      char *headbuf = (_withHeaders && headers == NULL) ? data->headers : NULL;
+      int ires = readFrame(_frameIndex, (traces == NULL) ? data->frame : NULL, headbuf);
+      if(ires < 0) return ires;
+      if(traces == NULL) traces = (const char*)data->frame;
+      if(headbuf != NULL) headers = headbuf;
+    }
+    data->mappedTR = m_pMappedTR;
+    data->mappedHD = m_pMappedHD;
+    newView.m_owner = data;
+    newView.m_traces = (const float*)traces;
+    newView.m_headers = headers;
+  }
+
+  m_lastView = newView;
+  view = newView;
+  return numLiveTraces;
+}
+
+int jsFileReader::getTraceView(const long _traceIndex, TraceView &view, bool _withHeaders) {
+  view.release();
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileReaderLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(_traceIndex < 0 || _traceIndex >= m_TotalNumOfTraces) {
+    ERROR_PRINTF(jsFileReaderLog, "Invalid trace index. %ld must be in [0,%ld)\n", _traceIndex, m_TotalNumOfTraces);
+    return JS_USERERROR;
+  }
+  long frameIndex = _traceIndex / m_numTraces;
+  int traceInFrame = _traceIndex % m_numTraces;
+
+  FrameView frame;
+  int numLiveTraces = getFrameView(frameIndex, frame, _withHeaders);
+  if(numLiveTraces < 0) return numLiveTraces;
+  if(traceInFrame >= numLiveTraces) return JS_WARNING;
+
+  view.m_frame = frame;
+  view.m_traceInFrame = traceInFrame;
+  view.m_traceIndex = _traceIndex;
+  return JS_OK;
+}
+
+long jsFileReader::getPrefetchHits() const {
+  return (m_pPrefetcher != NULL) ? m_pPrefetcher->getHits() : m_prefetchHits;
+}
+
+long jsFileReader::getPrefetchMisses() const {
+  return (m_pPrefetcher != NULL) ? m_pPrefetcher->getMisses() : m_prefetchMisses;
+}
+
 //read buflen number of bytes from TraceFile(s) into buf
 //buf must be pre-allocated with len=buflen
 int jsFileReader::readTraceBuffer(long offset, char *buf, long buflen) {
+  if(m_pMappedTR != NULL) {
+    const char *p = m_pMappedTR->getPointer(offset, buflen);
+    if(p != NULL) {
+      memcpy(buf, p, buflen);
+      return JS_OK;
+    }
+  }
+  // reads which bypass the read cache are issued as parallel requests with io_uring
+  if(m_IOBackendType == JS_IO_URING && !m_bDirectIO && bypassesCache(buflen)) return readBufferDirect(false, offset, buf, buflen);
+
   int lowInd = m_TrFileExtents->getExtentIndex(offset + 1);
   int upInd = m_TrFileExtents->getExtentIndex(offset + buflen);
   //   printf("\t %ld, %ld, %d, %d\n", offset, buflen, lowInd, upInd);
@@ -1307,7 +2124,9 @@ int jsFileReader::readTraceBuffer(long offset, char *buf, long buflen) {
         return JS_WARNING;
       }
       m_currIndexOfTrFileExtent = extInd;
-      m_pCachedReaderTR->setNewFile(m_curr_trffd, (*m_TrFileExtents)[extInd].getExtentSizeOnDisk());
+      int fileKey = (m_pSharedCache != NULL) ? m_pSharedCache->getFileId(fname) : extInd;
+      m_pCachedReaderTR->setNewFile(m_curr_trffd, (*m_TrFileExtents)[extInd].getExtentSizeOnDisk(), fileKey,
+                                    getSharedFd(false, extInd, true));
     }
     //      printf("extInd=%d, m_curr_trffd=%d, rest_buflen=%ld, loc_offset_trFile=%lu\n",extInd,m_curr_trffd,rest_buflen,loc_offset_trFile);
     //      ::pread (m_curr_trffd, &buf[buflen-rest_buflen], bytes2read, loc_offset_trFile);
@@ -1321,7 +2140,7 @@ int jsFileReader::readTraceBuffer(long offset, char *buf, long buflen) {
      }
      */
     rest_buflen -= bytes2read;
-    bytes2read = buflen - rest_buflen;
+    bytes2read = rest_buflen;
     loc_offset_trFile = 0;
   }
 
@@ -1331,6 +2150,16 @@ int jsFileReader::readTraceBuffer(long offset, char *buf, long buflen) {
 //read buflen number of bytes from TraceHeader(s) into buf
 //buf must be pre-allocated with len=buflen
 int jsFileReader::readHeaderBuffer(long offset, char *buf, long buflen) {
+  if(m_pMappedHD != NULL) {
+    const char *p = m_pMappedHD->getPointer(offset, buflen);
+    if(p != NULL) {
+      memcpy(buf, p, buflen);
+      return JS_OK;
+    }
+  }
+  // reads which bypass the read cache are issued as parallel requests with io_uring
+  if(m_IOBackendType == JS_IO_URING && !m_bDirectIO && bypassesCache(buflen)) return readBufferDirect(true, offset, buf, buflen);
+
   int lowInd = m_TrHeadExtents->getExtentIndex(offset + 1);
   int upInd = m_TrHeadExtents->getExtentIndex(offset + buflen);
 
@@ -1357,7 +2186,9 @@ int jsFileReader::readHeaderBuffer(long offset, char *buf, long buflen) {
         return JS_WARNING;
       }
       m_currIndexOfTrHeadExtent = extInd;
-      m_pCachedReaderHD->setNewFile(m_curr_trhfd, (*m_TrHeadExtents)[extInd].getExtentSizeOnDisk());
+      int fileKey = (m_pSharedCache != NULL) ? m_pSharedCache->getFileId(fname) : extInd;
+      m_pCachedReaderHD->setNewFile(m_curr_trhfd, (*m_TrHeadExtents)[extInd].getExtentSizeOnDisk(), fileKey,
+                                    getSharedFd(true, extInd, true));
     }
     //       printf("lowInd=%d, upInd=%d, extInd=%d, m_curr_trhfd=%d, bytes2read=%ld, loc_offset_trFile=%lu, glb_offest=%ld\n",lowInd, upInd, extInd,m_curr_trhfd, bytes2read, loc_offset_trFile, offset);
     //     long bread = ::pread(m_curr_trhfd, &buf[buflen-rest_buflen], bytes2read, loc_offset_trFile);
@@ -1372,6 +2203,7 @@ int jsFileReader::readHeaderBuffer(long offset, char *buf, long buflen) {
     }
 
     rest_buflen -= bytes2read;
+    bytes2read = rest_buflen;
     loc_offset_trFile = 0;
   }
 
@@ -28,6 +28,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
+#include <memory>
+#include <mutex>
 using std::vector;
 
 #include <unistd.h>
@@ -38,6 +40,8 @@ using std::vector;
 #include "jsStrDefs.h"
 #include "jsDefs.h"
 #include "jsByteOrder.h"
+#include "FrameView.h"
+#include "ReadContext.h"
 
 namespace jsIO {
 
@@ -58,6 +62,11 @@ class SeisPEG;
 class TraceMap;
 class catalogedHdrEntry;
 class IOCachedReader;
+class FramePrefetcher;
+class MappedExtents;
+class FrameBufferPool;
+class SharedBlockCache;
+class IOBackend;
 class VirtualFolders;
 
 /**
@@ -65,8 +74,8 @@ class VirtualFolders;
  * It supports all data formats defined in JavaSeis -
  * FLOAT, INT16, INT08, COMPRESSED_INT16, COMPRESSED_INT08 as well as SEISPEG.
  * Note that the usual read routines jsFileReader::readFrame or jsFileReader::readTrace ARE NOT thread safe
- * if you use one object instance in multiple threads (actually there is no
- * performance gain in reading multithreaded from files).
+ * if you use one object instance in multiple threads. To read concurrently from several threads,
+ * create one ReadContext per thread with jsFileReader::createReadContext.
  * However, one can use several threads for decompressing compressed data.
  * For usage examples see examples/testReader.cpp
  *
@@ -78,13 +87,14 @@ class VirtualFolders;
 class jsFileReader {
 
   friend class jsFileWriter;
+  friend class ReadContext;
 
 public:
   ~jsFileReader();
 
   /**
-   * @param _bufferSize cache-size used while reading from files (default: 2MB).
-   *                    Set 0 to read directly (not cached)
+   * @param _bufferSize cache-size used while reading from files (default: 2MB), split into pages of
+   *                    256KB (see setIOCache). Set 0 to read directly (not cached)
    */
   jsFileReader(const unsigned long _bufferSize = 2097152); //default: 2MB cache. Set 0, to read directly (not cached)
 
@@ -92,8 +102,17 @@ public:
    *  @brief Initalizes jsFileReader
    *  @param _jsfilename  the full name of javaseis dataset (i.e. inclusive the path)
    *  @param _NThreads number of threads that can be used in uncompressRawFrame function
+   *  @param _directIO if true, the extents are read with O_DIRECT, i.e. bypassing the system page cache.
+   *    The read caches (see setIOCache) read whole aligned pages, unaligned reads which bypass them are read
+   *    through an aligned bounce buffer. readFrameList reads frame by frame then, and the io_uring backend
+   *    (see setIOBackend) is not used. If the filesystem rejects O_DIRECT, the extents are read buffered.
    */
-  int Init(const std::string _jsfilename, const int _NThreads = 1, int wait = 0);
+  int Init(const std::string _jsfilename, const int _NThreads = 1, int wait = 0, bool _directIO = false);
+
+  ///@return true if the extents are read with O_DIRECT (see Init)
+  bool isDirectIO() const {
+    return m_bDirectIO;
+  }
 
   ///@return true if the dataset is regular, otherwise returns false
   bool isRegular() const;
@@ -168,6 +187,70 @@ public:
   unsigned long getIOBufferSize() const {
     return m_IOBufferSize;
   }
+
+  /**
+   * @brief Configures the read caches of the TraceFile and TraceHeaders extents
+   * @details
+   *   Each of both caches keeps up to _numPages pages of _pageSize bytes of any extent and replaces them
+   *   by the given policy, so random access (e.g. single traces) and alternating trace and header reads
+   *   don't read the same data again. Reads of a page size or more bypass the cache.
+   *   Clears the caches and their statistics. May be called before or after Init.
+   * @param _pageSize page size in bytes, 0 to read directly (not cached)
+   * @param _numPages number of pages in each cache
+   * @param _policy JS_CACHE_LRU or JS_CACHE_CLOCK
+   * @return JS_OK if successful
+   */
+  int setIOCache(unsigned long _pageSize, int _numPages, JS_CACHE_POLICY _policy = JS_CACHE_LRU);
+
+  ///@brief Returns the statistics of the TraceFile and TraceHeaders caches since Init or setIOCache
+  void getIOCacheStats(JS_CACHE_STATS &_traceStats, JS_CACHE_STATS &_headerStats) const;
+
+  /**
+   * @brief Configures the process-wide block cache which readers can share (see attachSharedCache)
+   * @details
+   *   The cache is thread-safe and split into _numShards shards with own locks. Blocks are keyed by extent file
+   *   and offset, so readers of the same dataset (e.g. one per worker thread) read each block only once.
+   *   Readers which are already attached keep using the previous cache until they attach again.
+   *   Datasets must not be modified while they are read through the shared cache.
+   * @param _budget memory budget of the cache in bytes, 0 to remove the cache
+   * @param _blockSize block size in bytes
+   * @param _numShards number of shards
+   * @return JS_OK if successful
+   */
+  static int configureSharedCache(unsigned long _budget, unsigned long _blockSize = 262144, int _numShards = 16);
+
+  ///@brief Returns the statistics of the process-wide block cache (directReads is not counted there)
+  static void getSharedCacheStats(JS_CACHE_STATS &_stats);
+
+  /**
+   * @brief Reads through the process-wide block cache instead of the own read caches (see configureSharedCache)
+   * @details May be called before or after Init. getIOCacheStats still counts the accesses of this reader.
+   * @param _attach true to attach to the current process-wide cache, false to detach
+   * @return JS_OK if successful, JS_USERERROR if no process-wide cache is configured
+   */
+  int attachSharedCache(bool _attach = true);
+
+  ///@return true if the reader reads through the process-wide block cache
+  bool isSharedCacheAttached() const {
+    return m_pSharedCache != NULL;
+  }
+
+  /**
+   * @brief Selects the backend of the bulk extent reads
+   * @details
+   *   JS_IO_PREAD (default) issues the reads of readFrameList with preadv on up to _NThreads (see Init) threads.
+   *   JS_IO_URING submits them to an io_uring and keeps up to _queueDepth of them in flight across all extents.
+   *   With JS_IO_URING the reads which bypass the read caches (a page size or more, e.g. readFrames) are split
+   *   into requests of 1MB and submitted the same way; they are not counted in getIOCacheStats.
+   *   If io_uring is not supported by the system or jseisIO was built without it, the pread backend is used.
+   * @param _type JS_IO_PREAD or JS_IO_URING
+   * @param _queueDepth maximum number of requests in flight (io_uring only)
+   * @return JS_OK if successful
+   */
+  int setIOBackend(JS_IO_BACKEND _type, int _queueDepth = 64);
+
+  ///@return the backend in use, JS_IO_PREAD if io_uring was requested but is not available
+  JS_IO_BACKEND getIOBackend();
   int getNDim() const;
   int getAxisLen(int index) const;
   int getAxisLogicalOrigin(int index) const;
@@ -299,6 +382,15 @@ public:
    */
   int liveToGlobalTraceIndex(const long _liveTraceIndex, long &_globalTraceIndex);
 
+  /**
+   * @brief Converts global trace index to live trace index
+   * @details
+   *  Inverse of liveToGlobalTraceIndex. If the trace with the index _globalTraceIndex is dead,
+   *  _liveTraceIndex is initialized with the index of the next live trace (getNtr() if there is none).
+   * @return JS_OK if the trace is live, JS_WARNING if it is dead, JS_USERERROR if the index is invalid
+   */
+  int globalToLiveTraceIndex(const long _globalTraceIndex, long &_liveTraceIndex);
+
   /**
    * @brief Reads multiple traces within live traces
    * @param _firstTraceIndex global index (within all live traces) of the first trace
@@ -309,10 +401,9 @@ public:
    */
   long readWithinLiveTraces(const long _firstTraceIndex, const long _numOfTraces, float *buffer, char *headbuf = NULL);
 
-  // Note that extensively random use of readWithinLiveTraces or readWithinLiveTraceHeaders functions can be noticeably slow in
-  // comparison to other reading routines, because each time for computing the file-offset of given live trace we have to
-  // read TraceMap from the beginning until the corresponding position.
-  // In case of sequentially use, we remember previous indices, so we don't need to read TraceMap from the beginning.
+  // Note that the first use of readWithinLiveTraces or readWithinLiveTraceHeaders (as well as liveToGlobalTraceIndex and
+  // globalToLiveTraceIndex) on a non-regular dataset reads the whole TraceMap once to build an index of live traces per frame.
+  // Afterwards each conversion of a live trace index is a binary search in this index.
 
   /**
    * @brief Reads headers of multiple traces within live traces
@@ -388,6 +479,163 @@ public:
    */
   int uncompressRawFrame(char *rawframe, int numLiveTraces, int iThread, float *frame, char *headbuf = NULL);
 
+  /**
+   * @brief Reads multiple consecutive frames
+   * @details
+   *   The raw frames are read with one I/O request and uncompressed in parallel by up to
+   *   _NThreads (see Init) OpenMP threads.
+   * @param _frameIndex global index of the first frame
+   * @param NFrames the number of frames to read
+   * @param[out] frames a pre-allocated float array (with a length at least NFrames * getAxisLen(0) * getAxisLen(1)) to save the frames
+   * @param[out] headbuf if not NULL, then a pre-allocated buffer (with a size at least NFrames * getAxisLen(1) * getNumBytesInHeader()) to save the frame headers
+   * @param[out] numLiveTraces if not NULL, then an array (with a length at least NFrames) to save the number of live traces in each frame
+   * @return the total number of live traces in the read frames, or an error code (<0)
+   */
+  long readFrames(const long _frameIndex, int NFrames, float *frames, char *headbuf = NULL, int *numLiveTraces = NULL);
+
+  /**
+   * @brief Reads a list of frames given by their global indices (e.g. every n-th frame of a volume)
+   * @details
+   *   The frames are read in file order: consecutive frames located in the same extent are coalesced into one
+   *   vectored read, and the reads are executed by the I/O backend (see setIOBackend). The frames
+   *   are then uncompressed in parallel like in readFrames. The read caches of the reader are bypassed.
+   * @param _frameIndices global indices of the frames, in any order
+   * @param NFrames the number of frames to read
+   * @param[out] frames a pre-allocated float array (with a length at least NFrames * getAxisLen(0) * getAxisLen(1)),
+   *   the frame _frameIndices[i] is saved at frames + i * getAxisLen(0) * getAxisLen(1)
+   * @param[out] headbuf if not NULL, then a pre-allocated buffer (with a size at least NFrames * getAxisLen(1) * getNumBytesInHeader()) to save the frame headers
+   * @param[out] numLiveTraces if not NULL, then an array (with a length at least NFrames) to save the number of live traces in each frame
+   * @return the total number of live traces in the read frames, or an error code (<0)
+   */
+  long readFrameList(const long *_frameIndices, int NFrames, float *frames, char *headbuf = NULL, int *numLiveTraces = NULL);
+
+  /**
+   * @brief Reads a hyperslab, i.e. a regularly sampled subvolume along all axes (e.g. a time slice, a range of inlines
+   *        or a window of samples)
+   * @details
+   *   Only the frames containing the hyperslab are read, like in readFrameList, and of full frames only the traces up
+   *   to the last requested one (except for SeisPEG data, which is uncompressed as whole frames). The frames are
+   *   uncompressed in parallel by up to _NThreads (see Init) OpenMP threads in batches of about 64MB, and the requested
+   *   samples are copied into buffer in the same parallel pass. The index along the trace axis is the position in the
+   *   full frame: the (left-justified) live traces of a non-full frame are placed by the value of their trace-axis
+   *   header, like in jseisUtil::read_vol, so their headers are read even if headbuf is NULL. Dead traces are returned
+   *   as zeros (with zero headers). If the trace axis has a logical delta of 0, the live traces are placed in their
+   *   stored order. As with readFrame(f, frame), SeisPEG traces are not remuted, whether headbuf is NULL or not.
+   * @param _start index (not logical coordinate) of the first element along each axis (getNDim() values)
+   * @param _count number of elements along each axis
+   * @param _stride step between the elements along each axis, or NULL for 1 along all axes
+   * @param[out] buffer a pre-allocated float array with a length at least _count[0]*_count[1]*...*_count[getNDim()-1],
+   *   the samples are stored with the first axis varying fastest
+   * @param[out] headbuf if not NULL, then a pre-allocated buffer (with a size at least _count[1]*...*_count[getNDim()-1] *
+   *   getNumBytesInHeader()) to save the headers of the traces
+   * @return the number of live traces in the hyperslab, or an error code (<0)
+   */
+  long readHyperslab(const int *_start, const int *_count, const int *_stride, float *buffer, char *headbuf = NULL);
+
+  /**
+   * @brief Enables read-ahead of frames in readFrame
+   * @details
+   *   readFrame tracks the accessed frame indices. Once the access is sequential or strided
+   *   (a constant step between consecutive frames), the next _depth raw frames are read by
+   *   a background thread, so that reading overlaps decompression of the current frame.
+   *   Trace headers of non-SeisPEG data are still read on demand.
+   *   Must be called after Init. Init and Close disable read-ahead.
+   * @param _depth the number of frames to read ahead, 0 disables read-ahead
+   * @return JS_OK if successful
+   */
+  int setPrefetch(int _depth);
+
+  /**
+   * @brief Sets the number of threads used to uncompress one SeisPEG frame in readFrame (default 1)
+   * @details Useful to reduce the latency of single frame reads of large frames. Must be called after Init.
+   * @return JS_OK if successful
+   */
+  int setSeisPEGThreads(int _nThreads);
+
+  /**
+   * @brief Sets whether the TraceMap (fold of each frame) is kept in memory as a whole
+   * @details
+   *   By default Init reads the TraceMap of a non-regular dataset with one read and keeps it in memory
+   *   (4 bytes per frame), if it is not larger than 256MB. Otherwise, or if disabled, the fold is read
+   *   a volume at a time, i.e. each access to another volume reads the TraceMap file again.
+   *   Called after Init, loads (regardless of the size) or releases the TraceMap of the opened dataset.
+   * @param _wholeMap true to keep the whole TraceMap in memory
+   * @return JS_OK if successful
+   */
+  int setTraceMapCache(bool _wholeMap);
+
+  /**
+   * @brief Enables the memory-mapped read mode
+   * @details
+   *   The TraceFile and TraceHeaders extents are mapped into memory on their first access. All read routines
+   *   then copy from the mappings instead of reading through the I/O cache, and getMappedFrame gives access to
+   *   FLOAT, INT16 and INT08 frames without any copy. Must be called after Init. Init and Close unmap the extents.
+   * @param _enable true to map the extents, false to unmap them
+   * @param _access access pattern hint passed to madvise: JS_ACCESS_SEQUENTIAL for scans in frame order,
+   *   JS_ACCESS_RANDOM for interactive access, or JS_ACCESS_NORMAL
+   * @return JS_OK if successful
+   */
+  int setMmap(bool _enable, JS_ACCESS_PATTERN _access = JS_ACCESS_NORMAL);
+
+  ///@return true if the memory-mapped read mode is enabled
+  bool isMmap() const {
+    return m_pMappedTR != NULL;
+  }
+
+  /**
+   * @brief Returns the frame given by its global index without copying (memory-mapped read mode only)
+   * @details
+   *   The returned pointers point into the mapped extents and stay valid until setMmap(false), Init or Close.
+   *   If the byte order of the data is not native, or a frame is not located within one extent, the frame is
+   *   copied (and byte-swapped) into buffers of the reader instead, which are overwritten by the next call.
+   *   Only for uncompressed data (FLOAT, INT16 and INT08).
+   * @param _frameIndex global index of the frame
+   * @param[out] traces the samples of the live traces as stored on disk (float, short or signed char), NULL if there are none
+   * @param[out] headbuf if not NULL, set to the headers of the live traces
+   * @return the number of live traces in the frame, or an error code (<0)
+   */
+  int getMappedFrame(const long _frameIndex, const char *&traces, const char **headbuf = NULL);
+
+  /**
+   * @brief Creates a context for reading from another thread
+   * @details
+   *   The context shares the metadata and file descriptors of this reader and has its own buffers,
+   *   decompressors and read caches (configured like the reader's), so each thread can read through
+   *   its own context concurrently. Must be called after Init; the context must be deleted before Close.
+   * @return the new context (to be deleted by the caller), or NULL on error
+   */
+  ReadContext *createReadContext();
+
+  /**
+   * @brief Returns a read-only view of the frame given by its global index
+   * @details
+   *   The frame is decoded into a buffer owned by the reader (any data format), so callers which only inspect
+   *   the data or forward it to a writer don't need an own buffer and copy. In the memory-mapped read mode
+   *   FLOAT frames in native byte order point directly into the mapped extents. Asking again for the same frame
+   *   returns the previous view without reading it again. The buffers stay valid as long as a view refers to them
+   *   and are reused by the reader after the last view of the frame was released.
+   * @param _frameIndex global index of the frame
+   * @param[out] view the view of the frame
+   * @param _withHeaders if true, the trace headers are read too
+   * @return the number of live traces in the frame, or an error code (<0)
+   */
+  int getFrameView(const long _frameIndex, FrameView &view, bool _withHeaders = true);
+
+  /**
+   * @brief Returns a read-only view of the trace given by its global index
+   * @details The view refers to the view of its frame (see getFrameView), consecutive traces of a frame share it.
+   * @param _traceIndex global index of the trace
+   * @param[out] view the view of the trace
+   * @param _withHeaders if true, the trace headers are read too
+   * @return JS_OK if successful, JS_WARNING if the trace is dead (the view stays empty), or an error code
+   */
+  int getTraceView(const long _traceIndex, TraceView &view, bool _withHeaders = true);
+
+  ///@return the number of frames readFrame took from the read-ahead buffers
+  long getPrefetchHits() const;
+  ///@return the number of frames readFrame had to read itself while read-ahead was enabled
+  long getPrefetchMisses() const;
+
   /**
    * @brief Returns the number of live traces in frame with global index _frameIndex
    */
@@ -453,6 +701,24 @@ private:
   long m_frameHeaderLength { };
 
   unsigned long m_IOBufferSize { };
+  unsigned long m_IOPageSize { };
+  int m_IONumPages { };
+  JS_CACHE_POLICY m_IOCachePolicy { };
+  std::shared_ptr<SharedBlockCache> m_pSharedCache;
+  JS_IO_BACKEND m_IOBackendType { JS_IO_PREAD };
+  int m_IOQueueDepth { 64 };
+  IOBackend *m_pIOBackend { }; // created on first use
+
+  //extent file descriptors shared by the read contexts (opened on first use)
+  std::mutex m_sharedFdMutex;
+  std::vector<int> m_sharedTrFds;
+  std::vector<int> m_sharedHdFds;
+  // O_DIRECT descriptors if m_bDirectIO, -2 if the filesystem rejects O_DIRECT
+  std::vector<int> m_sharedTrDirectFds;
+  std::vector<int> m_sharedHdDirectFds;
+  bool m_bDirectIO { };
+  bool m_bWholeTraceMap { true }; //see setTraceMapCache
+  mutable std::mutex m_trMapMutex;
   IOCachedReader *m_pCachedReaderHD { };
   IOCachedReader *m_pCachedReaderTR { };
 
@@ -481,16 +747,9 @@ private:
 
   std::string m_descriptiveName;
 
-  //these variables used in liveToGlobalTraceIndex to mimimize the access to TraceMap in
-  //case of sequentially calling liveToGlobalTraceIndex
-  long m_prev_firstTr1 { }; //liveTraceIndex preciously used in liveToGlobalTraceIndex
-  long m_prev_frInd1 { };  //global frame index corresponding to liveTraceIndex
-  long m_prev_numTraces1 { }; //number of live traces total in all frames till m_prev_frInd
-
-  //same as above, we just keep information on two access of liveToGlobalTraceIndex
-  long m_prev_firstTr2 { };
-  long m_prev_numTraces2 { };
-  long m_prev_frInd2 { };
+  //number of live traces in all frames before each frame of a non-regular dataset (m_TotalNumOfFrames+1 entries),
+  //built from the TraceMap at the first use of liveToGlobalTraceIndex or globalToLiveTraceIndex
+  std::vector<long> m_liveTracePrefix;
   //
   //tmp buffers for readTraces function
   float *m_frame { };
@@ -500,6 +759,22 @@ private:
   int m_numOfFrameLiveTraces { };
   int m_numOfFrameHeaderLiveTraces { };
 
+  //read-ahead, uses an own reader for the background reads
+  FramePrefetcher *m_pPrefetcher { };
+  jsFileReader *m_pPrefetchReader { };
+  long m_prefetchHits { };
+  long m_prefetchMisses { };
+
+  //memory-mapped read mode
+  std::shared_ptr<MappedExtents> m_pMappedTR; // shared with the frame views pointing into the mappings
+  std::shared_ptr<MappedExtents> m_pMappedHD;
+  char *m_mappedFrameCopy { }; // used by getMappedFrame if the frame can't be returned in place
+  char *m_mappedHeaderCopy { };
+
+  //frame and trace views
+  std::shared_ptr<FrameBufferPool> m_viewPool;
+  FrameView m_lastView; // returned again if the same frame is requested
+
 private:
   int initExtents(const std::string &jsfilename);
 
@@ -509,6 +784,18 @@ private:
   long getOffsetInExtents(int *indices, int len1d) const; // indices is in index
   int readTraceBuffer(long offset, char *buf, long buflen);
   int readHeaderBuffer(long offset, char *buf, long buflen);
+  void uncompressFrame(char *rawframe, int numLiveTraces, int iThread, float *frame, char *headbuf);
+  void uncompressFrames(int _NFrames, const int *nLive, char *rawframes, float *frames, char *headbuf);
+  int readFrameRanges(bool _header, const long *_frameIndices, const std::vector<int> &_order, const int *nLive, char *_buf,
+      long _stride);
+  void stopPrefetch();
+  void unmapExtents();
+  int getSharedFd(bool _header, int _extInd, bool _direct = false);
+  void closeSharedFds();
+  IOBackend *getBackend();
+  bool bypassesCache(long _buflen) const;
+  int readBufferDirect(bool _header, long _offset, char *_buf, long _buflen);
+  int buildLiveTraceIndex();
 
   int readSingleProperty(const std::string &_datasetPath, const std::string &_fileName, const std::string propertyName,
       std::string &propertyValue) const;
@@ -43,7 +43,14 @@
 #include "FileUtil.h"
 #include "Assertion.h"
 
-// #include "IOCachedWriter.h"
+#include "IOCachedWriter.h"
+#include "IOBackend.h"
+#include "DirectIO.h"
+#include "AsyncFrameWriter.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "PSProLogging.h"
 #include "compress/TraceCompressor.h"
@@ -52,6 +59,22 @@
 namespace jsIO {
 DECLARE_LOGGER(jsFileWriterLog);
 
+// size of the requests a large write is split into with the io_uring backend
+static const long IO_BACKEND_REQUEST_SIZE = 1024 * 1024;
+
+// compressor of one frame at a time and its output buffer (m_trBufferArrayLen bytes), see acquireEncoder
+struct FrameEncoder {
+  ~FrameEncoder() {
+    delete seispeg;
+    delete[] buffer;
+  }
+  char *buffer { };
+  SeisPEG *seispeg { };
+  TraceCompressor traceCompressor; // bound to traceBuffer, which wraps buffer
+  CharBuffer traceBuffer;
+  IntBuffer headerBuffer;
+};
+
 jsFileWriter::~jsFileWriter() {
   Close();
 }
@@ -70,15 +93,14 @@ jsFileWriter::jsFileWriter() {
   m_trMap = NULL;
   m_jsReader = NULL;
 
-  //    m_pCachedWriterHD = NULL;
-  //    m_pCachedWriterTR = NULL;
-  //    m_curr_trffd = -1;
-  //    m_curr_trhfd = -1;
   m_bTraceMapWritten = false;
 }
 
-void jsFileWriter::Close() {
+int jsFileWriter::Close() {
   m_bInit = false;
+  int ires = stopAsyncWrite();
+  deleteEncoders();
+  closeExtentFiles();
   if(m_gridDef != NULL) {
     delete m_gridDef;
     m_gridDef = NULL;
@@ -109,9 +131,223 @@ void jsFileWriter::Close() {
     m_trMap = NULL;
   }
   m_jsReader = NULL; // it points to outside reader, so just NULL it
+  return ires;
+}
+
+void jsFileWriter::closeExtentFiles() {
+  syncExtentFiles();
+  for(size_t i = 0; i < m_trFileFds.size(); i++) {
+    if(m_trFileFds[i] >= 0) ::close(m_trFileFds[i]);
+  }
+  for(size_t i = 0; i < m_trHeadFds.size(); i++) {
+    if(m_trHeadFds[i] >= 0) ::close(m_trHeadFds[i]);
+  }
+  for(size_t i = 0; i < m_trFileDirectFds.size(); i++) {
+    if(m_trFileDirectFds[i] >= 0) ::close(m_trFileDirectFds[i]);
+  }
+  for(size_t i = 0; i < m_trHeadDirectFds.size(); i++) {
+    if(m_trHeadDirectFds[i] >= 0) ::close(m_trHeadDirectFds[i]);
+  }
+  m_trFileFds.clear();
+  m_trHeadFds.clear();
+  m_trFileDirectFds.clear();
+  m_trHeadDirectFds.clear();
+  m_currIndexOfTrFileExtent = -1;
+  m_currIndexOfTrHeadExtent = -1;
+
+  if(m_pCachedWriterHD != NULL) {
+    delete m_pCachedWriterHD;
+    m_pCachedWriterHD = NULL;
+  }
+  if(m_pCachedWriterTR != NULL) {
+    delete m_pCachedWriterTR;
+    m_pCachedWriterTR = NULL;
+  }
+  if(m_pIOBackend != NULL) {
+    delete m_pIOBackend;
+    m_pIOBackend = NULL;
+  }
+}
+
+void jsFileWriter::setSyncPolicy(JS_SYNC_POLICY policy, int nFrames) {
+  // JS_SYNC_PER_FRAME writes bypass the cache, so it must not keep older data
+  flush();
+  m_syncPolicy = policy;
+  m_syncNFrames = (nFrames > 0) ? nFrames : 1;
+  std::lock_guard<std::mutex> lock(m_trMapMutex);
+  if(m_trMap != NULL) m_trMap->setDeferredWrites(m_syncPolicy != JS_SYNC_PER_FRAME);
+}
+
+void jsFileWriter::setDirectIO(bool _enable) {
+  // the cached data is written with the previous mode, then the caches get the new descriptors
+  flush();
+  std::lock_guard<std::mutex> lockTR(m_trMutex);
+  std::lock_guard<std::mutex> lockHD(m_hdMutex);
+  m_bDirectIO = _enable;
+  m_currIndexOfTrFileExtent = -1;
+  m_currIndexOfTrHeadExtent = -1;
+}
+
+int jsFileWriter::setIOBackend(JS_IO_BACKEND _type, int _queueDepth) {
+  if(_queueDepth < 1) {
+    ERROR_PRINTF(jsFileWriterLog, "Invalid queue depth %d", _queueDepth);
+    return JS_USERERROR;
+  }
+  std::lock_guard<std::mutex> lock(m_fdMutex);
+  m_IOBackendType = _type;
+  m_IOQueueDepth = _queueDepth;
+  if(m_pIOBackend != NULL) {
+    delete m_pIOBackend;
+    m_pIOBackend = NULL;
+  }
+  return JS_OK;
+}
+
+JS_IO_BACKEND jsFileWriter::getIOBackend() {
+  return getBackend()->getType();
+}
+
+IOBackend *jsFileWriter::getBackend() {
+  std::lock_guard<std::mutex> lock(m_fdMutex);
+  if(m_pIOBackend == NULL) m_pIOBackend = IOBackend::create(m_IOBackendType, m_IOQueueDepth, 1);
+  return m_pIOBackend;
+}
+
+int jsFileWriter::setAsyncWrite(int nWorkers, int queueDepth) {
+  int ires = stopAsyncWrite();
+  m_asyncWorkers = nWorkers;
+  m_asyncQueueDepth = queueDepth;
+  if(m_bInit) startAsyncWrite();
+  return ires;
+}
+
+void jsFileWriter::startAsyncWrite() {
+  if(m_asyncWorkers <= 0) return;
+  m_pAsyncWriter = new AsyncFrameWriter(m_asyncWorkers, m_asyncQueueDepth,
+  [this](AsyncFrameJob & job, int) -> int {
+    job.encodedLen = (long)job.numLiveTraces * (long)m_compess_traceSize;
+    if(m_bisFloat || job.numLiveTraces == 0) return JS_OK;
+    // the job keeps only the encoded bytes, the encoder is reused by the next frame
+    FrameEncoder *encoder = acquireEncoder();
+    job.encodedLen = encodeFrame(encoder, job.frame, job.headbuf, job.numLiveTraces);
+    if(job.encodedLen > 0) {
+      job.encoded = new char[job.encodedLen];
+      memcpy(job.encoded, encoder->buffer, job.encodedLen);
+    }
+    releaseEncoder(encoder);
+    return (job.encodedLen < 0) ? JS_USERERROR : JS_OK;
+  },
+  [this](AsyncFrameJob & job) -> int {
+    return writeEncodedFrame(job.frameIndex, job.frame, job.encoded, job.encodedLen, job.headbuf, job.numLiveTraces,
+                             job.bWriteTraceMap);
+  });
+}
+
+int jsFileWriter::stopAsyncWrite() {
+  if(m_pAsyncWriter == NULL) return JS_OK;
+  int ires = m_pAsyncWriter->finish();
+  delete m_pAsyncWriter;
+  m_pAsyncWriter = NULL;
+  if(ires != JS_OK) ERROR_PRINTF(jsFileWriterLog, "Asynchronous writing failed");
+  return ires;
+}
+
+int jsFileWriter::flush() {
+  int ires = JS_OK;
+  if(m_pAsyncWriter != NULL) ires = m_pAsyncWriter->flush();
+  int ires2 = syncExtentFiles();
+  return (ires != JS_OK) ? ires : ires2;
+}
+
+int jsFileWriter::syncExtentFiles() {
+  int ires = syncExtents();
+  // the folds are written after the traces, so that they never refer to unwritten data
+  std::lock_guard<std::mutex> lock(m_trMapMutex);
+  if(m_trMap != NULL && m_trMap->flushFolds() != JS_OK) {
+    ERROR_PRINTF(jsFileWriterLog, "Can't write TraceMap file");
+    ires = JS_WARNING;
+  }
+  return ires;
+}
+
+// flushes the cached writes and syncs the extents, without the TraceMap
+int jsFileWriter::syncExtents() {
+  int ires = JS_OK;
+  {
+    std::lock_guard<std::mutex> lock(m_trMutex);
+    if(m_pCachedWriterTR != NULL && !m_pCachedWriterTR->flush()) {
+      ERROR_PRINTF(jsFileWriterLog, "Can't flush cached data to TraceFile(s)");
+      ires = JS_WARNING;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_hdMutex);
+    if(m_pCachedWriterHD != NULL && !m_pCachedWriterHD->flush()) {
+      ERROR_PRINTF(jsFileWriterLog, "Can't flush cached data to TraceHeader(s)");
+      ires = JS_WARNING;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_fdMutex);
+    for(size_t i = 0; i < m_trFileFds.size(); i++) {
+      if(m_trFileFds[i] >= 0 && ::fsync(m_trFileFds[i]) != 0) ires = JS_WARNING;
+    }
+    for(size_t i = 0; i < m_trHeadFds.size(); i++) {
+      if(m_trHeadFds[i] >= 0 && ::fsync(m_trHeadFds[i]) != 0) ires = JS_WARNING;
+    }
+  }
+  return ires;
+}
+
+// sets the fold of a written frame, m_trMapMutex must be held. The deferred folds of the previous volume
+// are written when a frame of another volume comes, after its traces are synced
+int jsFileWriter::putTraceMapFold(long frameIndex, int numTraces) {
+  if(m_trMap->isPendingOtherVolume(frameIndex) && syncExtents() != JS_OK) {
+    ERROR_PRINTF(jsFileWriterLog, "Can't sync written frames to disk");
+    return JS_WARNING;
+  }
+  return m_trMap->putFold(frameIndex, numTraces);
+}
 
-  //    if(m_pCachedWriterHD!=NULL) delete m_pCachedWriterHD;
-  //    if(m_pCachedWriterTR!=NULL) delete m_pCachedWriterTR;
+// sync extents according to m_syncPolicy after frames [frameIndex, frameIndex+nFrames) were written.
+// JS_SYNC_PER_FRAME is handled directly in writeTraceBuffer/writeHeaderBuffer
+int jsFileWriter::syncFrames(long frameIndex, int nFrames) {
+  if(m_syncPolicy == JS_SYNC_PER_NFRAMES) {
+    bool bSync = false;
+    {
+      std::lock_guard<std::mutex> lock(m_fdMutex);
+      m_numFramesSinceSync += nFrames;
+      if(m_numFramesSinceSync >= m_syncNFrames) {
+        m_numFramesSinceSync = 0;
+        bSync = true;
+      }
+    }
+    if(bSync) return syncExtentFiles();
+  } else if(m_syncPolicy == JS_SYNC_PER_VOLUME) {
+    long framesPerVolume = (m_fileProps->numDimensions > 2) ? m_fileProps->axisLengths[2] : 1;
+    // sync if a volume was completed with these frames
+    if((frameIndex + nFrames) / framesPerVolume != frameIndex / framesPerVolume) return syncExtentFiles();
+  }
+  return JS_OK;
+}
+
+int jsFileWriter::getExtentFd(std::vector<int> &fds, ExtentList *extents, int extInd, int flags) {
+  std::lock_guard<std::mutex> lock(m_fdMutex);
+  if(flags & O_DIRECT) {
+    if(fds[extInd] == -1) {
+      fds[extInd] = openDirect((*extents)[extInd].getPath().c_str(), flags & ~O_DIRECT);
+      if(fds[extInd] < 0) fds[extInd] = -2; // written buffered
+    }
+    return fds[extInd];
+  }
+  if(fds[extInd] < 0) {
+    std::string fname = (*extents)[extInd].getPath();
+    fds[extInd] = ::open(fname.c_str(), flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if(fds[extInd] < 0) {
+      ERROR_PRINTF(jsFileWriterLog, "Can't open %s for writing!", fname.c_str());
+    }
+  }
+  return fds[extInd];
 }
 
 // setup names, default values which can be over written later
@@ -251,6 +487,9 @@ int jsFileWriter::Init(const jsWriterInput *_writerInput) {
   m_virtualFolders = _writerInput->virtualFolders;
   m_seispegPolicy = _writerInput->seispegPolicy;
   m_IOBufferSize = _writerInput->IOBufferSize;
+  setSyncPolicy(_writerInput->syncPolicy, _writerInput->syncNFrames);
+  setAsyncWrite(_writerInput->asyncWorkers, _writerInput->asyncQueueDepth);
+  m_bDirectIO = _writerInput->directIO;
   m_fileProps->dataType = _writerInput->dataDef->getDataType();
   m_fileProps->traceFormat = _writerInput->dataDef->getTraceFormat();
   m_fileProps->isMapped = _writerInput->isMapped;
@@ -386,11 +625,23 @@ int jsFileWriter::Initialize() {
     m_trBufferArrayLen = m_frameSize + SeisPEG::getOutputHdrBufferSize(m_headerLengthWords, m_numTraces);
   }
 
-  //    m_curr_trffd = -1;
-  //    m_curr_trhfd = -1;
-  //
-  //    m_pCachedWriterHD = new IOCachedWriter(-1, m_IOBufferSize);
-  //    m_pCachedWriterTR = new IOCachedWriter(-1, m_IOBufferSize);
+  stopAsyncWrite();
+  // the encoders depend on the format and the frame size, those used at the same time are created here once
+  deleteEncoders();
+  if(!m_bisFloat) {
+    std::vector<FrameEncoder*> encoders(std::max(m_asyncWorkers, 1));
+    for(size_t i = 0; i < encoders.size(); i++)
+      encoders[i] = acquireEncoder();
+    for(size_t i = 0; i < encoders.size(); i++)
+      releaseEncoder(encoders[i]);
+  }
+  closeExtentFiles();
+  m_trFileFds.assign(m_TrFileExtents->getNumExtents(), -1);
+  m_trHeadFds.assign(m_TrHeadExtents->getNumExtents(), -1);
+  m_trFileDirectFds.assign(m_TrFileExtents->getNumExtents(), -1);
+  m_trHeadDirectFds.assign(m_TrHeadExtents->getNumExtents(), -1);
+  m_pCachedWriterHD = new IOCachedWriter(-1, m_IOBufferSize);
+  m_pCachedWriterTR = new IOCachedWriter(-1, m_IOBufferSize);
 
   //**********
 
@@ -401,9 +652,12 @@ int jsFileWriter::Initialize() {
     for(int i = 0; i < m_numDim; i++)
       trMap_axes[i] = m_fileProps->axisLengths[i];
     m_trMap->Init(trMap_axes, m_numDim, m_byteOrder, m_filename, "rw");
+    m_trMap->setDeferredWrites(m_syncPolicy != JS_SYNC_PER_FRAME);
     delete[] trMap_axes;
   }
 
+  startAsyncWrite();
+
   m_bInit = true;
   return JS_OK;
 }
@@ -473,6 +727,7 @@ int jsFileWriter::writeMetaData(const int remove) {
   if(ires != JS_OK) return ires;
 
   //*** init TraceMap if mapped
+  if(m_pAsyncWriter != NULL) m_pAsyncWriter->flush(); // queued frames may still use the old TraceMap
   if(m_fileProps->isMapped) {
     if(m_trMap != NULL) delete m_trMap;
     m_trMap = new TraceMap;
@@ -484,6 +739,7 @@ int jsFileWriter::writeMetaData(const int remove) {
       // copy foldmap file;
       copy_file((m_jsReader->m_filename + JS_TRACE_MAP).c_str(), (m_filename + JS_TRACE_MAP).c_str());
     } else if(remove == 1) m_trMap->intializeTraceMapOnDisk();
+    m_trMap->setDeferredWrites(m_syncPolicy != JS_SYNC_PER_FRAME);
 
     delete[] trMap_axes;
   }
@@ -567,10 +823,65 @@ long jsFileWriter::getOffsetInExtents(int *indices, int len1d) {
   return glb_offset;
 }
 
+/*
+ * Writes _buflen bytes at the global offset _offset to the TraceFile(s) (or TraceHeaders) through the I/O backend,
+ * split into requests of IO_BACKEND_REQUEST_SIZE bytes which are in flight together, and syncs the extents.
+ */
+int jsFileWriter::writeBufferDirect(bool _header, long _offset, char *_buf, long _buflen) {
+  ExtentList *extents = _header ? m_TrHeadExtents : m_TrFileExtents;
+  std::vector<int> &fds = _header ? m_trHeadFds : m_trFileFds;
+  std::vector<struct iovec> iov;
+  std::vector<IORequest> reqs;
+  while(_buflen > 0) {
+    int extInd = extents->getExtentIndex(_offset + 1);
+    if(extInd < 0) {
+      ERROR_PRINTF(jsFileWriterLog, "Can't write %ld bytes starting from offset %ld", _buflen, _offset);
+      return JS_USERERROR;
+    }
+    int fd = getExtentFd(fds, extents, extInd, _header ? O_WRONLY : O_CREAT | O_WRONLY);
+    if(fd < 0) return JS_WARNING;
+    long extStart = (*extents)[extInd].getStartOffset();
+    long len = std::min(std::min(_buflen, IO_BACKEND_REQUEST_SIZE), extStart + (*extents)[extInd].getExtentSize() - _offset);
+    struct iovec v;
+    v.iov_base = _buf;
+    v.iov_len = len;
+    iov.push_back(v);
+    IORequest req;
+    req.fd = fd;
+    req.iovcnt = 1;
+    req.offset = _offset - extStart;
+    reqs.push_back(req);
+    _offset += len;
+    _buf += len;
+    _buflen -= len;
+  }
+  if(reqs.empty()) return JS_OK;
+  for(size_t i = 0; i < reqs.size(); i++)
+    reqs[i].iov = &iov[i];
+  if(getBackend()->write(&reqs[0], reqs.size()) != JS_OK) {
+    ERROR_PRINTF(jsFileWriterLog, "Can't write to %s", _header ? "TraceHeader(s)" : "TraceFile(s)");
+    return JS_WARNING;
+  }
+
+  for(size_t i = 0; i < reqs.size(); i++) {
+    if((i == 0 || reqs[i].fd != reqs[i - 1].fd) && ::fsync(reqs[i].fd) != 0) {
+      ERROR_PRINTF(jsFileWriterLog, "Can't sync %s to disk!", _header ? "TraceHeader(s)" : "TraceFile(s)");
+      return JS_WARNING;
+    }
+  }
+  return JS_OK;
+}
+
 int jsFileWriter::writeHeaderBuffer(long offset, char *buf, long buflen) {
   int lowInd = m_TrHeadExtents->getExtentIndex(offset + 1);
   int upInd = m_TrHeadExtents->getExtentIndex(offset + buflen);
 
+  if(m_pCachedWriterHD == NULL) {
+    ERROR_PRINTF(jsFileWriterLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  // synced right away anyway, so the whole buffer is submitted at once
+  if(m_syncPolicy == JS_SYNC_PER_FRAME && m_IOBackendType == JS_IO_URING && !m_bDirectIO) return writeBufferDirect(true, offset, buf, buflen);
   if(lowInd < 0 || upInd < 0 || upInd < lowInd) {
     ERROR_PRINTF(jsFileWriterLog, "Can't write %ld bytes starting from offset %ld in TraceHeader(s)", buflen, offset);
     return JS_USERERROR;
@@ -579,7 +890,6 @@ int jsFileWriter::writeHeaderBuffer(long offset, char *buf, long buflen) {
   long rest_buflen = buflen;
   long bytes2write = buflen;
   long loc_offset_trHeader = offset - (*m_TrHeadExtents)[lowInd].getStartOffset();
-  // IOCachedWriter* pCachedWriterHD = new IOCachedWriter(-1, m_IOBufferSize);
 
   for(int extInd = lowInd; extInd <= upInd; extInd++) {
     long extSize = (*m_TrHeadExtents)[extInd].getExtentSize();
@@ -587,26 +897,38 @@ int jsFileWriter::writeHeaderBuffer(long offset, char *buf, long buflen) {
       bytes2write = extSize - loc_offset_trHeader;
     }
 
-    std::string fname = (*m_TrHeadExtents)[extInd].getPath();
-    // int curr_trhfd = ::open(fname.c_str(), O_WRONLY | O_SYNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | O_DIRECT);
-    int curr_trhfd = ::open(fname.c_str(), O_WRONLY | O_SYNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    int curr_trhfd = getExtentFd(m_trHeadFds, m_TrHeadExtents, extInd, O_WRONLY);
     if(curr_trhfd < 0) {
       return JS_WARNING;
     }
-    // pCachedWriterHD->setNewFileDescriptor(curr_trhfd);
+    int direct_trhfd = m_bDirectIO ? getExtentFd(m_trHeadDirectFds, m_TrHeadExtents, extInd, O_WRONLY | O_DIRECT) : -1;
 
     bytes2write = std::min(bytes2write, rest_buflen);
-    // long bytesWritten = ::pwrite(curr_trhfd, &buf[buflen - rest_buflen], bytes2write, loc_offset_trHeader);
-    long bytesWritten = wrapIOFull(pwrite, curr_trhfd, &buf[buflen - rest_buflen], bytes2write, loc_offset_trHeader);
-    //       printf("extInd=%d, m_curr_trffd=%d, rest_buflen=%ld, loc_offset_trFile=%lu, bytesWritten=%ld, bytes2write=%ld\n",extInd,m_curr_trhfd,rest_buflen,loc_offset_trHeader, bytesWritten, bytes2write);
-    ::fsync(curr_trhfd);
-    ::close(curr_trhfd);
-    if(bytesWritten != bytes2write) {
-      return JS_WARNING;
+    if(m_syncPolicy == JS_SYNC_PER_FRAME) {
+      // synced right away anyway, so write directly (several threads may write in parallel)
+      // long bytesWritten = ::pwrite(curr_trhfd, &buf[buflen - rest_buflen], bytes2write, loc_offset_trHeader);
+      long bytesWritten = pwriteDirect(direct_trhfd, curr_trhfd, &buf[buflen - rest_buflen], bytes2write, loc_offset_trHeader);
+      if(bytesWritten != bytes2write || ::fsync(curr_trhfd) != 0) {
+        return JS_WARNING;
+      }
+    } else {
+      std::lock_guard<std::mutex> lock(m_hdMutex);
+      if(extInd != m_currIndexOfTrHeadExtent) {
+        // flushes the data cached for the previous extent
+        if(!m_pCachedWriterHD->setNewFileDescriptor(curr_trhfd, direct_trhfd)) {
+          ERROR_PRINTF(jsFileWriterLog, "Can't flush cached data to TraceHeader(s)");
+          return JS_WARNING;
+        }
+        m_currIndexOfTrHeadExtent = extInd;
+      }
+      if(!m_pCachedWriterHD->write(loc_offset_trHeader, (unsigned char*)&buf[buflen - rest_buflen], bytes2write)) {
+        return JS_WARNING;
+      }
     }
 
     rest_buflen -= bytes2write;
     loc_offset_trHeader = 0;
+    bytes2write = rest_buflen;
   }
 
   return JS_OK;
@@ -616,6 +938,12 @@ int jsFileWriter::writeTraceBuffer(long offset, char *buf, long buflen) {
   int lowInd = m_TrFileExtents->getExtentIndex(offset + 1);
   int upInd = m_TrFileExtents->getExtentIndex(offset + buflen);
 
+  if(m_pCachedWriterTR == NULL) {
+    ERROR_PRINTF(jsFileWriterLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  // synced right away anyway, so the whole buffer is submitted at once
+  if(m_syncPolicy == JS_SYNC_PER_FRAME && m_IOBackendType == JS_IO_URING && !m_bDirectIO) return writeBufferDirect(false, offset, buf, buflen);
   if(lowInd < 0 || upInd < 0 || upInd < lowInd) {
     ERROR_PRINTF(jsFileWriterLog, "Can't write %ld bytes starting from offset %ld in TraceFile(s)", buflen, offset);
     return JS_USERERROR;
@@ -624,7 +952,6 @@ int jsFileWriter::writeTraceBuffer(long offset, char *buf, long buflen) {
   long rest_buflen = buflen;
   long bytes2write = buflen;
   long loc_offset_trFile = offset - (*m_TrFileExtents)[lowInd].getStartOffset();
-  // IOCachedWriter* pCachedWriterTR = new IOCachedWriter(-1, m_IOBufferSize);
 
   for(int extInd = lowInd; extInd <= upInd; extInd++) {
     long extSize = (*m_TrFileExtents)[extInd].getExtentSize();
@@ -632,28 +959,46 @@ int jsFileWriter::writeTraceBuffer(long offset, char *buf, long buflen) {
       bytes2write = extSize - loc_offset_trFile;
     }
 
-    std::string fname = (*m_TrFileExtents)[extInd].getPath();
-    //int curr_trffd = ::open(fname.c_str(), O_CREAT | O_WRONLY | O_SYNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | O_DIRECT);
-    int curr_trffd = ::open(fname.c_str(), O_CREAT | O_WRONLY | O_SYNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    int curr_trffd = getExtentFd(m_trFileFds, m_TrFileExtents, extInd, O_CREAT | O_WRONLY);
     if(curr_trffd < 0) {
-      ERROR_PRINTF(jsFileWriterLog, "Can't create %s for writing!", fname.c_str());
       return JS_WARNING;
     }
+    int direct_trffd = m_bDirectIO ? getExtentFd(m_trFileDirectFds, m_TrFileExtents, extInd, O_WRONLY | O_DIRECT) : -1;
 
     // printf("buflen=%ld,rest_buflen=%ld,bytes2write=%ld,file_offset=%ld\n", buflen, rest_buflen, bytes2write, loc_offset_trFile);
     bytes2write = std::min(bytes2write, rest_buflen);
-    // long bytesWritten = ::pwrite(curr_trffd, &buf[buflen - rest_buflen], bytes2write, loc_offset_trFile);
-    long bytesWritten = wrapIOFull(pwrite, curr_trffd, &buf[buflen - rest_buflen], bytes2write, loc_offset_trFile);
-    // printf("extInd=%d, curr_trffd=%d, rest_buflen=%ld, loc_offset_trFile=%lu, bytesWritten=%ld, bytes2write=%ld\n",extInd,curr_trffd,rest_buflen,loc_offset_trFile, bytesWritten, bytes2write);
-    ::fsync(curr_trffd);
-    ::close(curr_trffd);
-    if(bytesWritten != bytes2write) {
-      ERROR_PRINTF(jsFileWriterLog, "%s: bytes written(%ld) do not match bytes to write(%ld)!", fname.c_str(), bytesWritten, bytes2write);
-      return JS_WARNING;
+    if(m_syncPolicy == JS_SYNC_PER_FRAME) {
+      // synced right away anyway, so write directly (several threads may write in parallel)
+      // long bytesWritten = ::pwrite(curr_trffd, &buf[buflen - rest_buflen], bytes2write, loc_offset_trFile);
+      long bytesWritten = pwriteDirect(direct_trffd, curr_trffd, &buf[buflen - rest_buflen], bytes2write, loc_offset_trFile);
+      if(bytesWritten != bytes2write) {
+        ERROR_PRINTF(jsFileWriterLog, "%s: bytes written(%ld) do not match bytes to write(%ld)!",
+                     (*m_TrFileExtents)[extInd].getPath().c_str(), bytesWritten, bytes2write);
+        return JS_WARNING;
+      }
+      if(::fsync(curr_trffd) != 0) {
+        ERROR_PRINTF(jsFileWriterLog, "%s: can't sync to disk!", (*m_TrFileExtents)[extInd].getPath().c_str());
+        return JS_WARNING;
+      }
+    } else {
+      std::lock_guard<std::mutex> lock(m_trMutex);
+      if(extInd != m_currIndexOfTrFileExtent) {
+        // flushes the data cached for the previous extent
+        if(!m_pCachedWriterTR->setNewFileDescriptor(curr_trffd, direct_trffd)) {
+          ERROR_PRINTF(jsFileWriterLog, "Can't flush cached data to TraceFile(s)");
+          return JS_WARNING;
+        }
+        m_currIndexOfTrFileExtent = extInd;
+      }
+      if(!m_pCachedWriterTR->write(loc_offset_trFile, (unsigned char*)&buf[buflen - rest_buflen], bytes2write)) {
+        ERROR_PRINTF(jsFileWriterLog, "%s: can't write %ld bytes!", (*m_TrFileExtents)[extInd].getPath().c_str(), bytes2write);
+        return JS_WARNING;
+      }
     }
 
     rest_buflen -= bytes2write;
     loc_offset_trFile = 0;
+    bytes2write = rest_buflen;
   }
 
   return JS_OK;
@@ -690,8 +1035,104 @@ int jsFileWriter::writeFrames(long frameIndex, float *frames, int nFrames) {
   //in case of regular data TraceMap may be written at once with WriteTraceMap4RegularData function
   //(should be faster than with m_trMap->putFold)
   if(m_trMap && !m_bTraceMapWritten) {
+    std::lock_guard<std::mutex> lock(m_trMapMutex);
+    for(int i = 0; i < nFrames; i++) {
+      int ires = putTraceMapFold(frameIndex + i, m_numTraces);
+      if(ires != JS_OK) {
+        ERROR_PRINTF(jsFileWriterLog, "Can't write TraceMap file");
+        return ires;
+      }
+    }
+  }
+
+  return syncFrames(frameIndex, nFrames);
+}
+
+int jsFileWriter::writeFrames(long frameIndex, float *frames, char *headbufs, const int *numLiveTraces, int nFrames,
+                              int nThreads) {
+  if(!m_bInit) {
+    ERROR_PRINTF(jsFileWriterLog, "Properties must be initialized first");
+    return JS_USERERROR;
+  }
+  if(nFrames <= 0 || frameIndex < 0 || frameIndex + nFrames - 1 >= m_TotalNumOfFrames) {
+    ERROR_PRINTF(jsFileWriterLog, "Invalid frame index. [%ld,%ld] must be in [0,%ld)", frameIndex, frameIndex + nFrames - 1,
+                 m_TotalNumOfFrames);
+    return JS_USERERROR;
+  }
+  std::vector<int> nLive(nFrames, m_numTraces);
+  for(int i = 0; numLiveTraces != NULL && i < nFrames; i++) {
+    if(numLiveTraces[i] < 0 || numLiveTraces[i] > m_numTraces) {
+      ERROR_PRINTF(jsFileWriterLog, "Invalid number of live traces %d in frame %ld", numLiveTraces[i], frameIndex + i);
+      return JS_USERERROR;
+    }
+    nLive[i] = numLiveTraces[i];
+  }
+  // frames queued by writeFrame must not overwrite these ones later
+  if(m_pAsyncWriter != NULL) {
+    int ires = m_pAsyncWriter->flush();
+    if(ires != JS_OK) return ires;
+  }
+
+  // compress the frames in parallel into their slots (m_frameSize bytes each) of one contiguous buffer
+  char *traceBuf = (char*)frames;
+  if(!m_bisFloat) {
+    traceBuf = new char[nFrames * m_frameSize];
+    long frameLen = (long)m_numSamples * m_numTraces;
+    std::vector<long> bytesInFrame(nFrames, 0);
+#ifdef _OPENMP
+    if(nThreads <= 0) nThreads = omp_get_max_threads();
+#endif
+    nThreads = std::max(1, std::min(nThreads, nFrames));
+#pragma omp parallel num_threads(nThreads)
+    {
+      FrameEncoder *encoder = acquireEncoder();
+#pragma omp for schedule(dynamic)
+      for(int i = 0; i < nFrames; i++) {
+        char *slot = &traceBuf[i * m_frameSize];
+        if(nLive[i] > 0) {
+          char *headbuf = (headbufs != NULL) ? &headbufs[i * m_frameHeaderSize] : NULL;
+          bytesInFrame[i] = encodeFrame(encoder, &frames[i * frameLen], m_bSeisPEG_data ? headbuf : NULL, nLive[i]);
+          if(bytesInFrame[i] < 0 || bytesInFrame[i] > (long)m_frameSize) {
+            bytesInFrame[i] = -1;
+            continue;
+          }
+          memcpy(slot, encoder->buffer, bytesInFrame[i]);
+        }
+        memset(slot + bytesInFrame[i], 0, m_frameSize - bytesInFrame[i]);
+      }
+      releaseEncoder(encoder);
+    }
     for(int i = 0; i < nFrames; i++) {
-      int ires = m_trMap->putFold(frameIndex + i, m_numTraces);
+      if(bytesInFrame[i] < 0) {
+        ERROR_PRINTF(jsFileWriterLog, "Can't compress frame %ld", frameIndex + i);
+        delete[] traceBuf;
+        return JS_USERERROR;
+      }
+    }
+  }
+
+  // the compressed slots are written whole, FLOAT frames (as their headers) only up to their last live trace
+  int ires;
+  if(m_bisFloat) ires = writeLiveTraces(false, frameIndex, traceBuf, nLive);
+  else ires = writeTraceBuffer(frameIndex * m_frameSize, traceBuf, m_frameSize * nFrames);
+  if(traceBuf != (char*)frames) delete[] traceBuf;
+  if(ires != JS_OK) {
+    ERROR_PRINTF(jsFileWriterLog, "Can't write frames into the file");
+    return ires;
+  }
+
+  if(headbufs != NULL && !m_bSeisPEG_data) { // in case of SeisPEG the headers are compressed with the traces
+    ires = writeLiveTraces(true, frameIndex, headbufs, nLive);
+    if(ires != JS_OK) {
+      ERROR_PRINTF(jsFileWriterLog, "Can't write frame headers into the file");
+      return ires;
+    }
+  }
+
+  if(m_trMap && (numLiveTraces != NULL || !m_bTraceMapWritten)) {
+    std::lock_guard<std::mutex> lock(m_trMapMutex);
+    for(int i = 0; i < nFrames; i++) {
+      ires = putTraceMapFold(frameIndex + i, nLive[i]);
       if(ires != JS_OK) {
         ERROR_PRINTF(jsFileWriterLog, "Can't write TraceMap file");
         return ires;
@@ -699,6 +1140,27 @@ int jsFileWriter::writeFrames(long frameIndex, float *frames, int nFrames) {
     }
   }
 
+  return syncFrames(frameIndex, nFrames);
+}
+
+// writes the traces (FLOAT data) or headers of consecutive frames, one write per run of full frames.
+// A partially live frame ends a run after its last live trace, the rest of it is left untouched as by writeFrame
+int jsFileWriter::writeLiveTraces(bool _header, long frameIndex, char *buf, const std::vector<int> &numLiveTraces) {
+  long frameBytes = _header ? m_frameHeaderSize : m_frameSize;
+  long traceBytes = _header ? m_headerLengthBytes : m_compess_traceSize;
+  int nFrames = numLiveTraces.size();
+  int runStart = 0;
+  for(int i = 0; i < nFrames; i++) {
+    if(numLiveTraces[i] == m_numTraces && i < nFrames - 1) continue;
+    long buflen = (i - runStart) * frameBytes + numLiveTraces[i] * traceBytes;
+    if(buflen > 0) {
+      long offset = (frameIndex + runStart) * frameBytes;
+      int ires = _header ? writeHeaderBuffer(offset, &buf[runStart * frameBytes], buflen)
+                         : writeTraceBuffer(offset, &buf[runStart * frameBytes], buflen);
+      if(ires != JS_OK) return ires;
+    }
+    runStart = i + 1;
+  }
   return JS_OK;
 }
 
@@ -855,67 +1317,152 @@ int jsFileWriter::writeFrame(long frameIndex, float *frame, char *headbuf, int n
     bWriteTraceMap = false;
   }
 
-  if(numLiveTraces > 0) {  // we do  need write anything.
+  if(m_pAsyncWriter != NULL) {
+    // the caller may reuse its buffers right after return, so queue a copy of the live traces
+    AsyncFrameJob *job = new AsyncFrameJob;
+    job->frameIndex = frameIndex;
+    job->numLiveTraces = numLiveTraces;
+    job->bWriteTraceMap = bWriteTraceMap;
+    size_t frameLen = (size_t)numLiveTraces * m_numSamples;
+    job->frame = new float[frameLen];
+    if(frameLen > 0) memcpy(job->frame, frame, frameLen * sizeof(float));
+    if(headbuf != NULL) {
+      // SeisPEG reads the headers as whole words
+      job->headbuf = new char[(size_t)numLiveTraces * m_headerLengthWords * 4]();
+      memcpy(job->headbuf, headbuf, (size_t)numLiveTraces * m_headerLengthBytes);
+    }
+    int ires = m_pAsyncWriter->submit(job);
+    if(ires != JS_OK) {
+      ERROR_PRINTF(jsFileWriterLog, "Asynchronous writing failed");
+      return ires;
+    }
+    return numLiveTraces;
+  }
+
+  FrameEncoder *encoder = NULL;
+  long bytesInFrame = (long)numLiveTraces * (long)m_compess_traceSize;
+  if(numLiveTraces > 0 && !m_bisFloat) {
+    //if dataFormat is not FLOAT - compress
+    encoder = acquireEncoder();
+    bytesInFrame = encodeFrame(encoder, frame, headbuf, numLiveTraces);
+    if(bytesInFrame < 0) {
+      ERROR_PRINTF(jsFileWriterLog, "Can't compress frame %ld", frameIndex);
+      releaseEncoder(encoder);
+      return JS_USERERROR;
+    }
+  }
 
-    long glb_offset = frameIndex * m_frameSize;
-    long bytesInFrame = (long)numLiveTraces * (long)m_compess_traceSize;
+  int ires = writeEncodedFrame(frameIndex, frame, (encoder != NULL) ? encoder->buffer : NULL, bytesInFrame, headbuf,
+                               numLiveTraces, bWriteTraceMap);
+  if(encoder != NULL) releaseEncoder(encoder);
+  if(ires != JS_OK) return ires;
+
+  return numLiveTraces;
+}
 
-    //////////////ji need change
-    // m_traceProps->setBuffer(headerBuffer);
+int jsFileWriter::writeFrameAsync(long frameIndex, float *frame, char *headbuf, int numLiveTraces) {
+  if(m_pAsyncWriter == NULL) {
+    int ires = writeFrame(frameIndex, frame, headbuf, numLiveTraces);
+    delete[] frame;
+    if(headbuf != NULL) delete[] headbuf;
+    return ires;
+  }
 
-    ///////////////ji
+  if(frameIndex < 0 || frameIndex >= m_TotalNumOfFrames) {
+    ERROR_PRINTF(jsFileWriterLog, "Invalid frame index. %ld must be in [0,%ld)\n", frameIndex, m_TotalNumOfFrames);
+    delete[] frame;
+    if(headbuf != NULL) delete[] headbuf;
+    return JS_USERERROR;
+  }
 
-    //write frame data
-    if(m_bisFloat) {     //if float, there is no need to uncompress, we can write directly  (should be faster)
-      //     if(nativeOrder()!=m_byteOrder){
-      //         endian_swap((void*)frame, bytesInFrame, sizeof(float));
-      //     }
-      //write only with native order
-      int ires = writeTraceBuffer(glb_offset, (char*)frame, bytesInFrame);
-      if(ires != JS_OK) {
-        ERROR_PRINTF(jsFileWriterLog, "Can't write frame into the file");
-        return ires;
-      }
+  AsyncFrameJob *job = new AsyncFrameJob;
+  job->frameIndex = frameIndex;
+  job->bWriteTraceMap = (numLiveTraces >= 0);
+  job->numLiveTraces = (numLiveTraces < 0) ? m_numTraces : numLiveTraces;
+  job->frame = frame;
+  job->headbuf = headbuf;
+  int ires = m_pAsyncWriter->submit(job);
+  if(ires != JS_OK) {
+    ERROR_PRINTF(jsFileWriterLog, "Asynchronous writing failed");
+    return ires;
+  }
+  return job->numLiveTraces;
+}
+
+// returns an idle encoder, a new one if all are in use (i.e. more frames are encoded at the same time than before)
+FrameEncoder *jsFileWriter::acquireEncoder() {
+  {
+    std::lock_guard<std::mutex> lock(m_encoderMutex);
+    if(!m_freeEncoders.empty()) {
+      FrameEncoder *encoder = m_freeEncoders.back();
+      m_freeEncoders.pop_back();
+      return encoder;
+    }
+  }
+  FrameEncoder *encoder = new FrameEncoder;
+  encoder->buffer = new char[m_trBufferArrayLen]();
+  if(m_bSeisPEG_data) {
+    SeisPEG_Policy policy = (m_seispegPolicy == 0) ? SEISPEG_POLICY_FASTEST : SEISPEG_POLICY_MAX_COMPRESSION;
+    encoder->seispeg = new SeisPEG(m_numSamples, m_numTraces, 0.1, policy);
+  } else {
+    encoder->traceBuffer.setByteOrder(m_byteOrder);
+    encoder->traceBuffer.wrap(encoder->buffer, m_frameSize);
+    encoder->traceCompressor.Init(m_fileProps->traceFormat, m_numSamples, &encoder->traceBuffer);
+  }
+  return encoder;
+}
+
+void jsFileWriter::releaseEncoder(FrameEncoder *encoder) {
+  std::lock_guard<std::mutex> lock(m_encoderMutex);
+  m_freeEncoders.push_back(encoder);
+}
+
+// must not be called while frames are encoded
+void jsFileWriter::deleteEncoders() {
+  std::lock_guard<std::mutex> lock(m_encoderMutex);
+  for(size_t i = 0; i < m_freeEncoders.size(); i++)
+    delete m_freeEncoders[i];
+  m_freeEncoders.clear();
+}
+
+// compresses numLiveTraces traces of frame (and in case of SeisPEG also the headers) into encoder->buffer.
+// Returns the number of bytes to write.
+long jsFileWriter::encodeFrame(FrameEncoder *encoder, float *frame, char *headbuf, int numLiveTraces) {
+  long bytesInFrame = (long)numLiveTraces * (long)m_compess_traceSize;
+
+  if(m_bSeisPEG_data) {
+    if(headbuf != NULL) {
+      encoder->headerBuffer.wrap((int*)headbuf, m_headerLengthWords * numLiveTraces);
+      bytesInFrame = encoder->seispeg->compress((float*)frame, numLiveTraces, &encoder->headerBuffer, m_headerLengthWords,
+                                                encoder->buffer);
+      encoder->seispeg->updateStatistics(numLiveTraces, m_numSamples, m_headerLengthWords, bytesInFrame);
     } else {
-      //if dataFormat is not FLOAT - uncompress
-      char *traceBufferArray = new char[m_trBufferArrayLen];
-      for(size_t i = 0; i < m_trBufferArrayLen; i++)
-        traceBufferArray[i] = 0;
-
-      if(m_bSeisPEG_data) {
-
-        SeisPEG_Policy policy = (m_seispegPolicy == 0) ? SEISPEG_POLICY_FASTEST : SEISPEG_POLICY_MAX_COMPRESSION;
-        SeisPEG *seispegCompressor = new SeisPEG(m_numSamples, m_numTraces, 0.1, policy);
-        if(headbuf != NULL) {
-          IntBuffer *seispegHeaderBuffer;
-          seispegHeaderBuffer = new IntBuffer;
-          seispegHeaderBuffer->wrap((int*)headbuf, m_headerLengthWords * numLiveTraces);
-          bytesInFrame = seispegCompressor->compress((float*)frame, numLiveTraces, seispegHeaderBuffer, m_headerLengthWords,
-                                                     traceBufferArray);
-          seispegCompressor->updateStatistics(numLiveTraces, m_numSamples, m_headerLengthWords, bytesInFrame);
-        } else {
-          bytesInFrame = seispegCompressor->compress((float*)frame, numLiveTraces, traceBufferArray);
-          seispegCompressor->updateStatistics(numLiveTraces, m_numSamples, 0, bytesInFrame);
-        }
-      } else {
-        TraceCompressor *traceCompressor = new TraceCompressor;
-        CharBuffer *traceBuffer = new CharBuffer;
-        traceBuffer->setByteOrder(m_byteOrder);
-        traceBuffer->wrap(traceBufferArray, m_frameSize);
-        traceCompressor->Init(m_fileProps->traceFormat, m_numSamples, traceBuffer);
-        traceBuffer->position(0);
-        traceCompressor->packFrame(numLiveTraces, frame);
-        delete traceCompressor;
-        delete traceBuffer;
-      }
+      bytesInFrame = encoder->seispeg->compress((float*)frame, numLiveTraces, encoder->buffer);
+      encoder->seispeg->updateStatistics(numLiveTraces, m_numSamples, 0, bytesInFrame);
+    }
+  } else {
+    encoder->traceBuffer.position(0);
+    encoder->traceCompressor.packFrame(numLiveTraces, frame);
+  }
 
-      int ires = writeTraceBuffer(glb_offset, traceBufferArray, bytesInFrame);
-      if(ires != JS_OK) {
-        ERROR_PRINTF(jsFileWriterLog, "Can't write frame into the file");
-        return ires;
-      }
+  return bytesInFrame;
+}
+
+// writes an already compressed frame (traceBuf, or frame itself for FLOAT data), its headers and fold
+int jsFileWriter::writeEncodedFrame(long frameIndex, float *frame, char *traceBuf, long bytesInFrame, char *headbuf,
+                                    int numLiveTraces, bool bWriteTraceMap) {
+  if(numLiveTraces > 0) {  // we do  need write anything.
 
-      delete[] traceBufferArray;
+    long glb_offset = frameIndex * m_frameSize;
+
+    //write frame data
+    //if float, there is no need to compress, we can write directly  (should be faster)
+    //write only with native order
+    char *buf = m_bisFloat ? (char*)frame : traceBuf;
+    int ires = writeTraceBuffer(glb_offset, buf, bytesInFrame);
+    if(ires != JS_OK) {
+      ERROR_PRINTF(jsFileWriterLog, "Can't write frame into the file");
+      return ires;
     }
 
     if(headbuf != NULL && !m_bSeisPEG_data) { //write frame header. In case of SeisPEG header is written with frame data
@@ -935,14 +1482,21 @@ int jsFileWriter::writeFrame(long frameIndex, float *frame, char *headbuf, int n
   //(should be faster than with m_trMap->putFold)
   // even if number of live trace is 0, we need update foldmap
   if(m_trMap && bWriteTraceMap == true) {
-    int ires = m_trMap->putFold(frameIndex, numLiveTraces);
+    std::lock_guard<std::mutex> lock(m_trMapMutex);
+    int ires = putTraceMapFold(frameIndex, numLiveTraces);
     if(ires != JS_OK) {
       ERROR_PRINTF(jsFileWriterLog, "Can't write TraceMap file");
       return ires;
     }
   }
 
-  return numLiveTraces;
+  int ires = syncFrames(frameIndex, 1);
+  if(ires != JS_OK) {
+    ERROR_PRINTF(jsFileWriterLog, "Can't sync written frames to disk");
+    return ires;
+  }
+
+  return JS_OK;
 }
 
 int jsFileWriter::writeFrameHeader(long frameIndex, char *headbuf) {
@@ -976,6 +1530,11 @@ int jsFileWriter::writeTraceMap4RegularData() {
   }
 
   if(m_fileProps->isMapped) {
+    {
+      // the deferred folds of frames written so far must not overwrite the regular map later
+      std::lock_guard<std::mutex> lock(m_trMapMutex);
+      if(m_trMap != NULL) m_trMap->flushFolds();
+    }
     //     TraceMap trMap(long* _axisLengths,  int _numAxis, ByteOrder _byteOrder, std::string path, std::string mode);
     std::string traceMapfile = m_filename + JS_TRACE_MAP;
     FILE *pfile = fopen(traceMapfile.c_str(), "w");
@@ -35,6 +35,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <vector>
+#include <mutex>
 
 #include "jsStrDefs.h"
 #include "jsDefs.h"
@@ -57,6 +58,9 @@ class DataDefinition;
 class catalogedHdrEntry;
 
 class IOCachedWriter;
+class IOBackend;
+struct FrameEncoder;
+class AsyncFrameWriter;
 
 class jsWriterInput;
 //for general non-regular data
@@ -277,6 +281,27 @@ public:
    */
   int writeFrame(long frameIndex, float *frame, char *headbuf = NULL, int numLiveTraces = -1);
 
+  /**
+   * @brief Writes frame to the dataset without copying it (zero-copy variant of writeFrame)
+   * @details The writer takes ownership of frame and headbuf, which must be allocated with
+   * allocFrameBuf() and allocHdrBuf() (i.e. with new[]), and deletes them when the frame is written.
+   * The caller must not touch the buffers after the call. Without asynchronous mode (see setAsyncWrite())
+   * the frame is written right away.
+   * @return the number of traces queued for writing or a negative error code
+   */
+  int writeFrameAsync(long frameIndex, float *frame, char *headbuf = NULL, int numLiveTraces = -1);
+
+  /**
+   * @brief Enables asynchronous (write-behind) mode
+   * @details writeFrame() then only queues a copy of the frame. nWorkers threads compress the queued frames
+   * in parallel and one I/O thread writes them in the order they were queued. At most queueDepth frames
+   * (default 4*nWorkers) are in flight, writeFrame() blocks if the queue is full. Errors are reported by the
+   * following writeFrame(), flush() or Close(). Set nWorkers to 0 to switch back to synchronous mode.
+   * Only writeFrame() and writeFrameAsync() are queued, the other write functions still write directly.
+   * @return JS_OK if all frames queued so far were written successfully
+   */
+  int setAsyncWrite(int nWorkers, int queueDepth = 0);
+
   /**
    * @brief Writes frame header to the dataset
    * @details In case of regular data, where we need NOT to to run leftJustify function
@@ -310,7 +335,7 @@ public:
   int writeFrames(int *posLogical, float *frames, int nFrames);
 
   /**
-   * @brief Writes several frames at once (works only for FLOAT data format)
+   * @brief Writes several frames at once (works only for FLOAT data format, see below for other formats)
    * @param frameIndex global index of the frame given in logical coordinates
    * @param frames frames to be written
    * @param nFrames number of frames to be written
@@ -318,6 +343,23 @@ public:
    */
   int writeFrames(long frameIndex, float *frames, int nFrames);
 
+  /**
+   * @brief Writes several consecutive frames at once, for any data format
+   * @details The frames are compressed in parallel (nThreads threads, by default as many as OpenMP uses) and
+   * written contiguously, i.e. with one write per extent (partially live FLOAT frames and headers split the
+   * writes, their dead traces are not written, as in writeFrame()). Frames queued with writeFrame() in asynchronous mode
+   * are written before.
+   * @param frameIndex global index of the first frame
+   * @param frames nFrames frames, each with getAxisLen(0)*getAxisLen(1) samples
+   * @param headbufs if not NULL, the headers of the frames, each getAxisLen(1)*getTraceHeaderSize() bytes
+   * @param numLiveTraces if not NULL, the number of live traces of each frame, which is written to the TraceMap.
+   *                      Otherwise all traces are live.
+   * @param nFrames number of frames to be written
+   * @param nThreads number of threads compressing the frames, 0 for the OpenMP default
+   * @return JS_OK if successful
+   */
+  int writeFrames(long frameIndex, float *frames, char *headbufs, const int *numLiveTraces, int nFrames, int nThreads = 0);
+
   /**
    * @brief Writes single trace (works only for FLOAT and regular data)
    * @param  traceIndex  global index of the trace to be written
@@ -332,8 +374,63 @@ public:
   int writeTraceBuffer(long offset, char *buf, long buflen);
   int writeHeaderBuffer(long offset, char *buf, long buflen);
 
-  ///Closes the dataset and flushes all caches
-  void Close();
+  /**
+   * @brief Set how often the written data is flushed to disk (fsync)
+   * @param policy JS_SYNC_PER_FRAME (default), JS_SYNC_PER_NFRAMES, JS_SYNC_PER_VOLUME or JS_SYNC_ON_CLOSE
+   * @param nFrames number of frames between two syncs, used only with JS_SYNC_PER_NFRAMES
+   * @details With JS_SYNC_PER_FRAME every write goes directly to disk. With the other policies the
+   * writes are cached (see getIOBufferSize()), so the data may not be visible to readers before flush() or Close().
+   * The same holds for the TraceMap: with JS_SYNC_PER_FRAME the fold of each frame is written and synced at once
+   * (safe for several processes writing into the same dataset), otherwise the folds of a volume are collected in memory
+   * and written after the extents are synced: on the sync of the policy, when a frame of another volume is written,
+   * on flush() and Close().
+   */
+  void setSyncPolicy(JS_SYNC_POLICY policy, int nFrames = 1);
+
+  JS_SYNC_POLICY getSyncPolicy() const {
+    return m_syncPolicy;
+  }
+
+  /**
+   * @brief Writes the extents with O_DIRECT, i.e. bypassing the system page cache
+   * @param _enable true to enable direct I/O
+   * @details The block-aligned (4KB) part of every write goes to disk directly, from the write cache
+   * or through an aligned bounce buffer; the unaligned head and tail bytes, which share blocks with
+   * neighbouring frames, and the TraceMap are written buffered. If the filesystem rejects O_DIRECT,
+   * the extents are written buffered. The io_uring backend (see setIOBackend) is not used in this mode.
+   */
+  void setDirectIO(bool _enable);
+
+  bool isDirectIO() const {
+    return m_bDirectIO;
+  }
+
+  /**
+   * @brief Selects the backend of the direct extent writes
+   * @param _type JS_IO_PREAD (default) or JS_IO_URING
+   * @param _queueDepth maximum number of requests in flight (io_uring only)
+   * @details With JS_IO_URING and JS_SYNC_PER_FRAME the buffers of writeTraceBuffer and writeHeaderBuffer
+   * (e.g. several frames of writeFrames) are split into requests of 1MB, which are in flight together across
+   * all extents. Cached writes (the other sync policies) are not affected. If io_uring is not supported by the
+   * system or jseisIO was built without it, the pread backend is used.
+   * @return JS_OK if successful
+   */
+  int setIOBackend(JS_IO_BACKEND _type, int _queueDepth = 64);
+
+  ///@return the backend in use, JS_IO_PREAD if io_uring was requested but is not available
+  JS_IO_BACKEND getIOBackend();
+
+  /**
+   * @brief Writes all queued and cached data to TraceFile(s) and TraceHeader(s) and syncs them to disk
+   * @return JS_OK if successful
+   */
+  int flush();
+
+  /**
+   * @brief Closes the dataset and flushes all caches
+   * @return JS_OK, or the error of a failed asynchronous write
+   */
+  int Close();
 
   TraceProperties* getTraceProps() const {
     return m_traceProps;
@@ -389,13 +486,39 @@ private:
   JS_BYTEORDER m_byteOrder { };
 
   size_t m_IOBufferSize { };
-  //      IOCachedWriter *m_pCachedWriterHD;
-  //      IOCachedWriter *m_pCachedWriterTR;
-
-  //      int m_currIndexOfTrFileExtent;
-  //      int m_curr_trffd;
-  //      int m_currIndexOfTrHeadExtent;
-  //      int m_curr_trhfd;
+  IOCachedWriter *m_pCachedWriterHD { };
+  IOCachedWriter *m_pCachedWriterTR { };
+
+  // descriptors of the extents (indexed as in m_TrFileExtents/m_TrHeadExtents), opened on first
+  // write and kept open until Close(); -1 if not opened yet
+  std::mutex m_fdMutex;
+  std::mutex m_trMutex; // guards m_pCachedWriterTR
+  std::mutex m_hdMutex; // guards m_pCachedWriterHD
+  std::mutex m_trMapMutex; // guards m_trMap
+  std::vector<int> m_trFileFds;
+  std::vector<int> m_trHeadFds;
+  // O_DIRECT descriptors of the extents if m_bDirectIO, -2 if the filesystem rejects O_DIRECT
+  std::vector<int> m_trFileDirectFds;
+  std::vector<int> m_trHeadDirectFds;
+  bool m_bDirectIO { };
+  int m_currIndexOfTrFileExtent { -1 };
+  int m_currIndexOfTrHeadExtent { -1 };
+
+  // idle encoders (compressor and output buffer), reused by writeFrame and the asynchronous workers
+  std::mutex m_encoderMutex;
+  std::vector<FrameEncoder*> m_freeEncoders;
+
+  AsyncFrameWriter *m_pAsyncWriter { };
+  int m_asyncWorkers { };
+  int m_asyncQueueDepth { };
+
+  JS_IO_BACKEND m_IOBackendType { JS_IO_PREAD };
+  int m_IOQueueDepth { 64 };
+  IOBackend *m_pIOBackend { }; // created on first use
+
+  JS_SYNC_POLICY m_syncPolicy { JS_SYNC_PER_FRAME };
+  int m_syncNFrames { 1 };
+  long m_numFramesSinceSync { };
 
   int m_numDim { };
 
@@ -405,6 +528,25 @@ private:
   long getOffsetInExtents(int *indices, int len1d); // indices must be in index
 
   void axisGridToProps(GridDefinition *gridDef);
+
+  int getExtentFd(std::vector<int> &fds, ExtentList *extents, int extInd, int flags);
+  IOBackend *getBackend();
+  int writeBufferDirect(bool _header, long _offset, char *_buf, long _buflen);
+  int syncFrames(long frameIndex, int nFrames);
+  int syncExtentFiles();
+  int syncExtents();
+  int putTraceMapFold(long frameIndex, int numTraces);
+  void closeExtentFiles();
+
+  void startAsyncWrite();
+  int stopAsyncWrite();
+  long encodeFrame(FrameEncoder *encoder, float *frame, char *headbuf, int numLiveTraces);
+  FrameEncoder *acquireEncoder();
+  void releaseEncoder(FrameEncoder *encoder);
+  void deleteEncoders();
+  int writeEncodedFrame(long frameIndex, float *frame, char *traceBuf, long bytesInFrame, char *headbuf, int numLiveTraces,
+                        bool bWriteTraceMap);
+  int writeLiveTraces(bool _header, long frameIndex, char *buf, const std::vector<int> &numLiveTraces);
 };
 }
 
@@ -49,6 +49,11 @@ jsWriterInput::jsWriterInput() {
   traceProps = new TraceProperties;
   customProps = new CustomProperties;
   IOBufferSize = 2 * 1024 * 1024; //default 2MB
+  syncPolicy = JS_SYNC_PER_FRAME;
+  syncNFrames = 1;
+  asyncWorkers = 0;
+  asyncQueueDepth = 0;
+  directIO = false;
 }
 
 void jsWriterInput::CopyClass(const jsWriterInput &Other) {
@@ -58,6 +63,11 @@ void jsWriterInput::CopyClass(const jsWriterInput &Other) {
   NExtends = Other.NExtends;
   isMapped = Other.isMapped;
   IOBufferSize = Other.IOBufferSize;
+  syncPolicy = Other.syncPolicy;
+  syncNFrames = Other.syncNFrames;
+  asyncWorkers = Other.asyncWorkers;
+  asyncQueueDepth = Other.asyncQueueDepth;
+  directIO = Other.directIO;
   virtualFolders = Other.virtualFolders;
   *gridDef = *(Other.gridDef);
   *dataDef = *(Other.dataDef);
@@ -33,6 +33,7 @@
 #include "DataDomain.h"
 #include "AxisLabel.h"
 #include "Units.h"
+#include "jsDefs.h"
 
 namespace jsIO {
 class GridDefinition;
@@ -82,6 +83,33 @@ public:
     IOBufferSize = _cacheSize;
   }
 
+  /**
+   * @brief Set how often the written data is flushed to disk (fsync).
+   * @details Default is JS_SYNC_PER_FRAME. With JS_SYNC_PER_NFRAMES the extents are synced
+   * after every _nFrames written frames, with JS_SYNC_ON_CLOSE only in jsFileWriter::Close().
+   */
+  void setSyncPolicy(JS_SYNC_POLICY _policy, int _nFrames = 1) {
+    syncPolicy = _policy;
+    syncNFrames = _nFrames;
+  }
+
+  /**
+   * @brief Enable asynchronous writing with _nWorkers compression threads.
+   * @details See jsFileWriter::setAsyncWrite. Default is 0, i.e. synchronous writing.
+   */
+  void setAsyncWrite(int _nWorkers, int _queueDepth = 0) {
+    asyncWorkers = _nWorkers;
+    asyncQueueDepth = _queueDepth;
+  }
+
+  /**
+   * @brief Write the extents with O_DIRECT, bypassing the system page cache.
+   * @details See jsFileWriter::setDirectIO. Default is false.
+   */
+  void setDirectIO(bool _enable) {
+    directIO = _enable;
+  }
+
   /**
    * @brief Set number of extents to use.
    * @details This number defines to how many parts/extents TraceData and TraceHeader will be splited.
@@ -161,6 +189,11 @@ private:
   int NExtends;
   bool isMapped;
   unsigned long IOBufferSize; //set 0, to write directly (not cached)
+  JS_SYNC_POLICY syncPolicy;
+  int syncNFrames; //used with JS_SYNC_PER_NFRAMES
+  int asyncWorkers; //0 - synchronous writing
+  int asyncQueueDepth;
+  bool directIO; //O_DIRECT
   std::vector<std::string> virtualFolders;
   GridDefinition *gridDef;
   DataDefinition *dataDef;
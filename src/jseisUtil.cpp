@@ -17,11 +17,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <linux/limits.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace jsIO {
 
 string jseisUtil::JS_DIR;
 
+// raw bytes of the frames read at once by read_vol
+static const long READ_VOL_CHUNK_BYTES = 256L * 1024 * 1024;
+
 jseisUtil::jseisUtil() {
 }
 
@@ -385,6 +391,30 @@ int oJseisND::write_frame(float *data, char *hdr, int iframe, int ivolume, int i
   return JS_OK;
 }
 
+// default headers of the traces of a frame
+void oJseisND::fill_frameHeader(char *hdr, int iframe, int ivolume, int ihypercube) {
+  for(int i2 = 0; i2 < _n2; i2++) {
+    itrcTypeHdr.setIntVal(&hdr[i2 * traceheaderSize], 1); // default 1 is OK
+    itrcHdr.setIntVal(&hdr[i2 * traceheaderSize], _io2 + i2 * _inc2);
+    ifrmHdr.setIntVal(&hdr[i2 * traceheaderSize], _io3 + iframe * _inc3);
+    if(_ndim > 3) ivolHdr.setIntVal(&hdr[i2 * traceheaderSize], _io4 + ivolume * _inc4);
+    if(_ndim > 4) ihyperHdr.setIntVal(&hdr[i2 * traceheaderSize], _io5 + ihypercube * _inc5);
+    fRecElevHdr.setFloatVal(&hdr[i2 * traceheaderSize], 0);
+    dRecXHdr.setDoubleVal(&hdr[i2 * traceheaderSize], _o2 + i2 * _d2);
+    dRecYHdr.setDoubleVal(&hdr[i2 * traceheaderSize], _o3 + i2 * _d3);
+    fSouElevHdr.setFloatVal(&hdr[i2 * traceheaderSize], 0);
+    dSouXHdr.setDoubleVal(&hdr[i2 * traceheaderSize], _o2 + i2 * _d2);
+    dSouYHdr.setDoubleVal(&hdr[i2 * traceheaderSize], _o3 + i2 * _d3);
+    dCdpXHdr.setDoubleVal(&hdr[i2 * traceheaderSize], _o2 + i2 * _d2);
+    dCdpYHdr.setDoubleVal(&hdr[i2 * traceheaderSize], _o3 + i2 * _d3);
+    fAOffsetHdr.setFloatVal(&hdr[i2 * traceheaderSize], 0);
+    iXLineHdr.setIntVal(&hdr[i2 * traceheaderSize], _io2 + i2 * _inc2);
+    iInLineHdr.setIntVal(&hdr[i2 * traceheaderSize], _io3 + iframe * _inc3);
+    iSourceHdr.setIntVal(&hdr[i2 * traceheaderSize], _io3 + iframe * _inc3);
+    iChanHdr.setIntVal(&hdr[i2 * traceheaderSize], _io2 + i2 * _inc2);
+  }
+}
+
 int oJseisND::write_frame(float *data, int iframe, int ivolume, int ihypercube) { // index start from 0
 
   if(iframe >= _n3 || (_ndim > 3 && ivolume >= _n4) || (_ndim > 4 && ihypercube >= _n5)) {
@@ -394,26 +424,7 @@ int oJseisND::write_frame(float *data, int iframe, int ivolume, int ihypercube)
 
   //  fprintf(stderr, "JS write_frame:(%d %d %d)\n", iframe,  ivolume, ihypercube);
 
-  for(int i2 = 0; i2 < _n2; i2++) {
-    itrcTypeHdr.setIntVal(&hdbuf[i2 * traceheaderSize], 1); // default 1 is OK
-    itrcHdr.setIntVal(&hdbuf[i2 * traceheaderSize], _io2 + i2 * _inc2);
-    ifrmHdr.setIntVal(&hdbuf[i2 * traceheaderSize], _io3 + iframe * _inc3);
-    if(_ndim > 3) ivolHdr.setIntVal(&hdbuf[i2 * traceheaderSize], _io4 + ivolume * _inc4);
-    if(_ndim > 4) ihyperHdr.setIntVal(&hdbuf[i2 * traceheaderSize], _io5 + ihypercube * _inc5);
-    fRecElevHdr.setFloatVal(&hdbuf[i2 * traceheaderSize], 0);
-    dRecXHdr.setDoubleVal(&hdbuf[i2 * traceheaderSize], _o2 + i2 * _d2);
-    dRecYHdr.setDoubleVal(&hdbuf[i2 * traceheaderSize], _o3 + i2 * _d3);
-    fSouElevHdr.setFloatVal(&hdbuf[i2 * traceheaderSize], 0);
-    dSouXHdr.setDoubleVal(&hdbuf[i2 * traceheaderSize], _o2 + i2 * _d2);
-    dSouYHdr.setDoubleVal(&hdbuf[i2 * traceheaderSize], _o3 + i2 * _d3);
-    dCdpXHdr.setDoubleVal(&hdbuf[i2 * traceheaderSize], _o2 + i2 * _d2);
-    dCdpYHdr.setDoubleVal(&hdbuf[i2 * traceheaderSize], _o3 + i2 * _d3);
-    fAOffsetHdr.setFloatVal(&hdbuf[i2 * traceheaderSize], 0);
-    iXLineHdr.setIntVal(&hdbuf[i2 * traceheaderSize], _io2 + i2 * _inc2);
-    iInLineHdr.setIntVal(&hdbuf[i2 * traceheaderSize], _io3 + iframe * _inc3);
-    iSourceHdr.setIntVal(&hdbuf[i2 * traceheaderSize], _io3 + iframe * _inc3);
-    iChanHdr.setIntVal(&hdbuf[i2 * traceheaderSize], _io2 + i2 * _inc2);
-  }
+  fill_frameHeader(hdbuf, iframe, ivolume, ihypercube);
 
   int numLiveTraces = _n2; //jsWrt.leftJustify(data, hdbuf, _n2); // does not needed for all trc_type == 1
   int i3 = ihypercube * _n4 * _n3 + ivolume * _n3 + iframe;
@@ -426,44 +437,68 @@ int oJseisND::write_frame(float *data, int iframe, int ivolume, int ihypercube)
   return JS_OK;
 }
 
+void oJseisND::setNumThreads(int nThreads) {
+  _nThreads = nThreads;
+}
+
+// the frames of a volume are left justified (or get their headers) and compressed in parallel, then written at once
 int oJseisND::write_volume(float *data, char *hdr, int ivolume, int ihypercube) { // index start from 0
+  if((_ndim > 3 && ivolume >= _n4) || (_ndim > 4 && ihypercube >= _n5)) {
+    fprintf(stderr, "JS write_volume:(%d %d) out of bound(%d %d)\n", ivolume, ihypercube, _n4, _n5);
+    return JS_FATALERROR;
+  }
+
+  vector<int> numLiveTraces(_n3);
+#pragma omp parallel for num_threads(_nThreads > 0 ? _nThreads : omp_get_max_threads()) schedule(dynamic)
   for(int ifr = 0; ifr < _n3; ifr++) {
-    write_frame(data + (size_t)_n1 * _n2 * ifr, hdr + (size_t)traceheaderSize * _n2 * ifr, ifr, ivolume, ihypercube);
+    numLiveTraces[ifr] = jsWrt.leftJustify(data + (size_t)_n1 * _n2 * ifr, hdr + (size_t)traceheaderSize * _n2 * ifr, _n2);
+  }
+
+  long frameIndex = (long)ihypercube * _n4 * _n3 + ivolume * _n3;
+  int ires = jsWrt.writeFrames(frameIndex, data, hdr, &numLiveTraces[0], _n3, _nThreads);
+  if(ires != JS_OK) {
+    fprintf(stderr, "Error while writing frames %ld-%ld\n", frameIndex, frameIndex + _n3 - 1);
+    return JS_FATALERROR;
   }
   return JS_OK;
 }
 
 int oJseisND::write_volume(float *data, int ivolume, int ihypercube) { // index start from 0
+  if((_ndim > 3 && ivolume >= _n4) || (_ndim > 4 && ihypercube >= _n5)) {
+    fprintf(stderr, "JS write_volume:(%d %d) out of bound(%d %d)\n", ivolume, ihypercube, _n4, _n5);
+    return JS_FATALERROR;
+  }
+
+  size_t frameHeaderSize = (size_t)traceheaderSize * _n2;
+  vector<char> volhdr(frameHeaderSize * _n3);
+#pragma omp parallel for num_threads(_nThreads > 0 ? _nThreads : omp_get_max_threads()) schedule(dynamic)
   for(int ifr = 0; ifr < _n3; ifr++) {
-    write_frame(data + (size_t)_n1 * _n2 * ifr, ifr, ivolume, ihypercube);
+    memcpy(&volhdr[frameHeaderSize * ifr], hdbuf, frameHeaderSize);
+    fill_frameHeader(&volhdr[frameHeaderSize * ifr], ifr, ivolume, ihypercube);
+  }
+
+  long frameIndex = (long)ihypercube * _n4 * _n3 + ivolume * _n3;
+  int ires = jsWrt.writeFrames(frameIndex, data, &volhdr[0], NULL, _n3, _nThreads);
+  if(ires != JS_OK) {
+    fprintf(stderr, "Error while writing frames %ld-%ld\n", frameIndex, frameIndex + _n3 - 1);
+    return JS_FATALERROR;
   }
   return JS_OK;
 }
 
+// all traces of the volume are live, so no left justification is needed
 int oJseisND::write_volume_reg(float *data, char *hdr, int ivolume, int ihypercube) { // index start from 0
   if((_ndim > 3 && ivolume >= _n4) || (_ndim > 4 && ihypercube >= _n5)) {
     fprintf(stderr, "JS write_volume_reg:(%d %d) out of bound(%d %d)\n", ivolume, ihypercube, _n4, _n5);
     return JS_FATALERROR;
   }
-  if(!(jsWrt.getTraceFormatName() == "FLOAT")) {
-    fprintf(stderr, "Must be float and full size to use write_volume_reg method!!!");
-    return JS_FATALERROR;
-  }
 
   long frameIndex = (long)ihypercube * _n4 * _n3 + ivolume * _n3;
-  int ires = jsWrt.writeFrames(frameIndex, data, _n3);
+  int ires = jsWrt.writeFrames(frameIndex, data, hdr, NULL, _n3, _nThreads);
   if(ires != JS_OK) {
     fprintf(stderr, "write data volume error");
     return ires;
   }
-
-  long frameHeaderSize = jsWrt.getHdrBufSize();
-  long glb_hd_offset = frameIndex * frameHeaderSize;
-  ires = jsWrt.writeHeaderBuffer(glb_hd_offset, hdr, frameHeaderSize * _n3);
-  if(ires != JS_OK) {
-    fprintf(stderr, "write header volume error");
-    return ires;
-  }
   return JS_OK;
 }
 
@@ -593,7 +628,11 @@ int jseisUtil::check_vol(jsFileReader &js, const char *fname0, vector<int> &axis
   string descname;
   string fname = fullname(fname0, descname);
 
-  int ierr = js.Init(fname);
+  int nThreads = 1;
+#ifdef _OPENMP
+  nThreads = omp_get_max_threads(); // read_vol uncompresses the frames on all cores
+#endif
+  int ierr = js.Init(fname, nThreads);
   if(ierr != 1) {
     fprintf(stderr, "Error in JavaSeis file %s\n", fname.c_str());
     exit(-1);
@@ -678,6 +717,10 @@ int jseisUtil::load_vol(const char *fname0, float *data, size_t bufsize, vector<
   return ndim;
 }
 
+// the frames are read in chunks of about READ_VOL_CHUNK_BYTES raw bytes with readFrames, i.e. with one read per chunk,
+// and uncompressed in parallel by the threads of js (see jsFileReader::Init). The live traces of non-full frames are
+// then moved to their positions in parallel, using the headers read with the chunk. The traces are uncompressed
+// without headers as by readFrame(i, data), so for SeisPEG the headers of non-full frames are read with readFrameHeader
 int jseisUtil::read_vol(jsFileReader &js, float *data, int n1, int n2, int n3, int io2, int inc2) {
   vector<string> axisHdrs;
   getAxisHdrs(js, axisHdrs);
@@ -687,23 +730,48 @@ int jseisUtil::read_vol(jsFileReader &js, float *data, int n1, int n2, int n3, i
   size_t sizeHdrs = (size_t)n2 * nbhdr;
   size_t size2d = (size_t)n1 * n2;
 
-  vector<float> buf(size2d);
-  char *hdbuf = NULL;
-  for(int i = 0; i < n3; i++) {
-    int n2live = js.readFrame(i, &data[size2d * i]);
-
-    if(n2live < n2) {  // handle non-full frames and put into the right positions in array
-      memcpy(&buf[0], &data[size2d * i], sizeof(float) * n1 * n2live);
-      memset(&data[size2d * i], 0, sizeof(float) * size2d);
-      if(hdbuf == NULL) hdbuf = new char[sizeHdrs];
-      js.readFrameHeader(i, hdbuf);
-      for(int ir = 0; ir < n2live; ir++) {
-        int i2 = (int)nearbyintf((frameHdr.getLongVal(hdbuf + (size_t)ir * nbhdr) - io2) / (float)inc2);
-        memcpy(&data[size2d * i + (size_t)i2 * n1], &buf[(size_t)ir * n1], sizeof(float) * n1);
+  int chunk = std::max(1L, std::min((long)n3, READ_VOL_CHUNK_BYTES / std::max(1L, js.getNumBytesInRawFrame())));
+  vector<int> nLive(chunk);
+  vector<char> hdbuf;
+  for(int i0 = 0; i0 < n3; i0 += chunk) {
+    int nf = std::min(chunk, n3 - i0);
+    bool nonFull = false;
+    for(int i = 0; i < nf && !nonFull; i++)
+      nonFull = js.getNumOfLiveTraces(i0 + i) < n2;
+    if(nonFull && hdbuf.empty()) hdbuf.resize(sizeHdrs * chunk);
+
+    // SeisPEG frames uncompressed with their headers would come back remuted
+    bool withHeaders = nonFull && !js.isSeisPEG();
+    long ntr = js.readFrames(i0, nf, &data[size2d * i0], withHeaders ? &hdbuf[0] : NULL, &nLive[0]);
+    if(ntr < 0) {
+      fprintf(stderr, "Error while reading frames %d-%d\n", i0, i0 + nf - 1);
+      return (int)ntr;
+    }
+    if(!nonFull) continue;
+    for(int i = 0; i < nf && !withHeaders; i++) {
+      if(nLive[i] < n2 && js.readFrameHeader(i0 + i, &hdbuf[sizeHdrs * i]) < 0) {
+        fprintf(stderr, "Error while reading the headers of frame %d\n", i0 + i);
+        return JS_USERERROR;
+      }
+    }
+
+#pragma omp parallel
+    {
+      vector<float> buf(size2d);
+#pragma omp for schedule(dynamic)
+      for(int i = 0; i < nf; i++) {
+        int n2live = nLive[i];
+        if(n2live >= n2) continue;
+        float *frame = &data[size2d * (i0 + i)];
+        memcpy(&buf[0], frame, sizeof(float) * n1 * n2live);
+        memset(frame, 0, sizeof(float) * size2d);
+        for(int ir = 0; ir < n2live; ir++) {
+          int i2 = (int)nearbyintf((frameHdr.getLongVal(&hdbuf[sizeHdrs * i + (size_t)ir * nbhdr]) - io2) / (float)inc2);
+          memcpy(&frame[(size_t)i2 * n1], &buf[(size_t)ir * n1], sizeof(float) * n1);
+        }
       }
     }
   }
-  delete[] hdbuf;
 
   return JS_OK;
 }
@@ -67,6 +67,7 @@ public:
   int _inc1 = 1, _inc2 = 1, _inc3 = 1, _inc4 = 1, _inc5 = 1;
   float _d1 = 1, _d2 = 1, _d3 = 1, _d4 = 1, _d5 = 1;
   float _o1 = 0, _o2 = 0, _o3 = 0, _o4 = 0, _o5 = 0;
+  int _nThreads = 0; // threads used by write_volume, 0 means the OpenMP default
 
 public:
   //constructor used by slave after the master have created the output file already
@@ -86,9 +87,13 @@ public:
   int write_volume(float *data, char *hdr, int ivolume, int ihypercube = 0); // index start from 0
   int write_volume(float *data, int ivolume, int ihypercube = 0); // index start from 0
   int write_volume_reg(float *data, char *hdr, int ivolume, int ihypercube = 0); // index start from 0
+  void setNumThreads(int nThreads); // threads which fill headers and compress frames in write_volume(_reg)
   float* allocFrameBuf();
   char* allocHdrBuf(bool initVals = true);
 
+private:
+  void fill_frameHeader(char *hdr, int iframe, int ivolume, int ihypercube);
+
 };
 
 class oJseisShots {